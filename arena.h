@@ -0,0 +1,139 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include "mem.h"
+
+//alignment of every arena allocation, wide enough for any SIMD load
+#define ARENA_ALIGN 64
+
+//Linear (bump) allocator. Memory comes from a chain of blocks and is only ever given back all at once
+//with arena_reset, which keeps the blocks for reuse, or arena_free. The arena never holds more than
+//budget bytes of blocks so a runaway allocation fails instead of eating the machine
+typedef struct ArenaBlock {
+
+	struct ArenaBlock *next;	//next block in the chain
+	size_t size;			//bytes of usable memory in this block
+	size_t used;			//bytes handed out from this block
+} ArenaBlock;
+
+typedef struct {
+
+	ArenaBlock *first;	//first block in the chain
+	ArenaBlock *current;	//block allocations are currently bumped from
+	size_t block_size;	//usable size of a new block, larger allocations get a block of their own
+	size_t budget;		//max bytes of blocks the arena may hold, 0 for no limit
+	size_t reserved;	//bytes of blocks currently held
+	size_t used;		//bytes handed out since the last reset
+	size_t peak;		//highest value of used
+} Arena;
+
+//block header is padded so the data that follows it stays aligned
+#define ARENA_HEADER (((sizeof(ArenaBlock) + ARENA_ALIGN - 1) / ARENA_ALIGN) * ARENA_ALIGN)
+
+static inline void arena_init(Arena *a, size_t block_size, size_t budget) {
+
+	*a = (Arena) {0};
+	a->block_size = block_size;
+	a->budget = budget;
+}
+
+static inline void *arena_alloc(Arena *a, size_t size) {
+
+	size = (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+
+	//move on to the next block until one has room, blocks after current were emptied by the last reset
+	while (a->current != NULL && a->current->used + size > a->current->size && a->current->next != NULL) {
+
+		a->current = a->current->next;
+		a->current->used = 0;
+	}
+
+	if (a->current == NULL || a->current->used + size > a->current->size) {
+
+		size_t block = (size > a->block_size) ? size : a->block_size;
+
+		block = (block + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+
+		//blocks after the current one are empty since the last reset, give them back before giving up on the budget
+		while (a->budget != 0 && a->reserved + ARENA_HEADER + block > a->budget && a->current != NULL && a->current->next != NULL) {
+
+			ArenaBlock *spare = a->current->next;
+
+			a->current->next = spare->next;
+			a->reserved -= ARENA_HEADER + spare->size;
+			mem_free(spare);
+		}
+
+		if (a->budget != 0 && a->reserved + ARENA_HEADER + block > a->budget) {
+
+			return NULL;
+		}
+
+		ArenaBlock *b = mem_aligned_alloc(MEM_ARENA, ARENA_ALIGN, ARENA_HEADER + block);
+
+		if (b == NULL) {
+
+			return NULL;
+		}
+
+		b->size = block;
+		b->used = 0;
+		a->reserved += ARENA_HEADER + block;
+
+		//link the new block in after the current one so emptied blocks further on are kept
+		if (a->current == NULL) {
+
+			b->next = a->first;
+			a->first = b;
+
+		} else {
+
+			b->next = a->current->next;
+			a->current->next = b;
+		}
+
+		a->current = b;
+	}
+
+	void *p = (unsigned char *) a->current + ARENA_HEADER + a->current->used;
+
+	a->current->used += size;
+	a->used += size;
+	a->peak = (a->used > a->peak) ? a->used : a->peak;
+
+	return p;
+}
+
+//give back everything allocated from the arena in one go, the blocks are kept for reuse
+static inline void arena_reset(Arena *a) {
+
+	a->current = a->first;
+	a->used = 0;
+
+	if (a->first != NULL) {
+
+		a->first->used = 0;
+	}
+}
+
+static inline void arena_free(Arena *a) {
+
+	ArenaBlock *b = a->first;
+
+	while (b != NULL) {
+
+		ArenaBlock *next = b->next;
+		mem_free(b);
+		b = next;
+	}
+
+	a->first = NULL;
+	a->current = NULL;
+	a->reserved = 0;
+	a->used = 0;
+}
+
+#endif
@@ -0,0 +1,122 @@
+//micro benchmark comparing the span blitter in graphics.c against the original per pixel draw_sprite
+//compile from the repo root:
+//gcc -O2 bench/blit_bench.c graphics.c profile.c trace.c xstats.c mem.c -I. -o blit_bench -lX11 -lm
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "graphics.h"
+
+#define BLITS 20000
+
+//the original draw_sprite, bounds and alpha tested for every pixel
+static void draw_sprite_ref(App *app, Sprite *s, int start_x, int start_y) {
+
+	for (int y = 0; y < s->height; y++) {
+
+		for (int x = 0; x < s->width; x++) {
+
+			int screen_x = start_x + x;
+			int screen_y = start_y + y;
+
+			if (screen_x >= 0 && screen_x < app->pixel_buffer_w && screen_y >= 0 && screen_y < app->pixel_buffer_h) {
+
+				uint32_t color = s->pixels[y * s->width + x];
+
+				if ((color & 0xFF000000) != 0) {
+			
+					app->pixel_buffer[screen_y * app->pixel_buffer_w + screen_x] = color;
+				}
+			}
+		}
+	}
+}
+
+static double now(void) {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+//make a sprite with an opaque disc in the middle and transparent corners
+static void make_disc(Sprite *s, int size) {
+
+	*s = (Sprite) {0};
+	s->width = size;
+	s->height = size;
+	s->channels = 4;
+	s->pixels = (uint32_t *) mem_alloc(MEM_SPRITE, size * size * sizeof(uint32_t));
+
+	for (int y = 0; y < size; y++) {
+		
+		for (int x = 0; x < size; x++) {
+			
+			int dx = x - size / 2;
+			int dy = y - size / 2;
+			int inside = dx * dx + dy * dy < (size / 2) * (size / 2);
+
+			s->pixels[y * size + x] = inside ? (0x80000000 | (x << 8) | y) : 0;
+		}
+	}
+
+	sprite_build_spans(s);
+}
+
+static double run(App *app, Sprite *s, void (*blit)(App *, Sprite *, int, int)) {
+
+	double start = now();
+
+	for (int i = 0; i < BLITS; i++) {
+		
+		//walk positions across the buffer, some of them clipped by the edges
+		int x = (i * 97) % (app->pixel_buffer_w + s->width) - s->width / 2;
+		int y = (i * 61) % (app->pixel_buffer_h + s->height) - s->height / 2;
+
+		blit(app, s, x, y);
+	}
+
+	return (now() - start) * 1e9 / BLITS;
+}
+
+static void bench(char *name, Sprite *s) {
+
+	App ref = {0};
+	App app = {0};
+	
+	ref.pixel_buffer_w = app.pixel_buffer_w = PBUF_WIDTH;
+	ref.pixel_buffer_h = app.pixel_buffer_h = PBUF_HEIGHT;
+	ref.pixel_buffer = (uint32_t *) calloc(PBUF_WIDTH * PBUF_HEIGHT, sizeof(uint32_t));
+	app.pixel_buffer = (uint32_t *) calloc(PBUF_WIDTH * PBUF_HEIGHT, sizeof(uint32_t));
+
+	double t_ref = run(&ref, s, draw_sprite_ref);
+	double t_span = run(&app, s, draw_sprite);
+	int same = memcmp(ref.pixel_buffer, app.pixel_buffer, PBUF_WIDTH * PBUF_HEIGHT * sizeof(uint32_t)) == 0;
+	double t_blend = run(&app, s, draw_sprite_blend);
+
+	printf("%-12s %4dx%-4d  ref %8.0f ns  span %8.0f ns (%.2fx, %s)  blend %8.0f ns\n", name, s->width, s->height, t_ref, t_span, t_ref / t_span, same ? "match" : "MISMATCH", t_blend);
+
+	free(ref.pixel_buffer);
+	free(app.pixel_buffer);
+}
+
+int main(void) {
+
+	Sprite font = {0};
+	Sprite disc;
+
+	if (load_sprite(&font, "fontmap.png") != 0) {
+		
+		return 1;
+	}
+
+	make_disc(&disc, 128);
+
+	bench("fontmap.png", &font);
+	bench("disc", &disc);
+
+	sprite_free(&font);
+	sprite_free(&disc);
+
+	return 0;
+}
@@ -0,0 +1,192 @@
+//checks that the hits found by the bullet sweep are applied to the asteroids they were found on
+//two bullets on one asteroid must only destroy it once, and the fragments it splits into must not be hit
+//by a bullet whose own asteroid was destroyed earlier in the same tick. Every order the bullets can be
+//live in is tried, so whichever slot the pool hands a fragment the outcome has to be the same
+//compile from the repo root, it needs ship.ply and asteroid1.ply so run it from there too:
+//gcc -O2 bench/collision_check.c graphics.c jobs.c replay.c profile.c trace.c xstats.c mem.c -I. -o collision_check -lX11 -lm -pthread
+
+#define main xteroids_main
+#include "xteroids.c"
+#undef main
+
+#define MAX_TARGETS 4
+
+//an asteroid placed for a scene
+typedef struct {
+
+	float x;
+	float y;
+	asteroid_size_t size;
+} Target;
+
+//a scene, each bullet sits on the centre of target[aim] and doesn't move
+typedef struct {
+
+	const char *name;
+	Target targets[MAX_TARGETS];
+	int target_count;
+	int aims[MAX_TARGETS];
+	int bullet_count;
+} Scene;
+
+static const Scene scenes[] = {
+
+	{"two bullets on one large, one each on two smalls far apart", {{300, 200, AST_LARGE}, {-400, -100, AST_SMALL}, {-400, 300, AST_SMALL}}, 3, {0, 0, 1, 2}, 4},
+	{"two bullets on one small, one on a large far away", {{-400, -100, AST_SMALL}, {300, 200, AST_LARGE}}, 2, {0, 0, 1}, 3}
+};
+
+//run one tick of collisions with the bullets made in the order given, returns 1 if the outcome is wrong
+static int run_scene(JobSystem *jobs, Ship *ship, AsteroidField *asteroids, BulletPool *bullets, const Scene *scene, const int *order) {
+
+	if (new_game(ship, asteroids, bullets, DEFAULT_SEED) != 0) {
+
+		return 1;
+	}
+
+	ship->model.position = (Vector3) {0.0f, 0.0f, 0.0f};
+
+	for (int t = 0; t < scene->target_count; t++) {
+
+		add_asteroid(asteroids, &asteroids->rng, scene->targets[t].x, scene->targets[t].y, scene->targets[t].size);
+	}
+
+	for (int k = 0; k < scene->bullet_count; k++) {
+
+		const Target *target = &scene->targets[scene->aims[order[k]]];
+		Bullet *b = &bullets->items[pool_alloc(&bullets->pool)];
+
+		*b = (Bullet) {0};
+		b->model.position = (Vector3) {target->x, -target->y, 0.0f};
+		b->model.prev_position = b->model.position;
+	}
+
+	check_collisions(jobs, ship, asteroids, bullets);
+
+	//every target takes exactly one bullet, the rest carry on
+	int bullets_left = scene->bullet_count - scene->target_count;
+	int fragments = 0;
+	int failed = 0;
+
+	for (int t = 0; t < scene->target_count; t++) {
+
+		fragments += (scene->targets[t].size == AST_SMALL) ? 0 : 3;
+	}
+
+	if (bullets->pool.live_count != bullets_left) {
+
+		printf("  %d bullets left, expected %d\n", bullets->pool.live_count, bullets_left);
+		failed = 1;
+	}
+
+	if (asteroids->pool.live_count != fragments) {
+
+		printf("  %d asteroids left, expected %d fragments\n", asteroids->pool.live_count, fragments);
+		failed = 1;
+	}
+
+	//only fragments are left and each one is where an asteroid was split
+	for (int k = 0; k < asteroids->pool.live_count; k++) {
+
+		int i = asteroids->pool.live[k];
+		int found = 0;
+
+		for (int t = 0; t < scene->target_count; t++) {
+
+			const Target *target = &scene->targets[t];
+
+			found |= asteroids->pos_x[i] == target->x && asteroids->pos_y[i] == target->y && asteroids->size[i] == target->size - 1;
+		}
+
+		if (!found) {
+
+			printf("  unexpected asteroid of size %d at %.0f,%.0f\n", asteroids->size[i], asteroids->pos_x[i], asteroids->pos_y[i]);
+			failed = 1;
+		}
+	}
+
+	return failed;
+}
+
+//step order to the next permutation in lexicographic order, returns 0 after the last one
+static int next_order(int *order, int n) {
+
+	int i = n - 2;
+
+	while (i >= 0 && order[i] >= order[i + 1]) {
+
+		i--;
+	}
+
+	if (i < 0) {
+
+		return 0;
+	}
+
+	int j = n - 1;
+
+	while (order[j] <= order[i]) {
+
+		j--;
+	}
+
+	int tmp = order[i];
+	order[i] = order[j];
+	order[j] = tmp;
+
+	for (int a = i + 1, b = n - 1; a < b; a++, b--) {
+
+		tmp = order[a];
+		order[a] = order[b];
+		order[b] = tmp;
+	}
+
+	return 1;
+}
+
+int main(void) {
+
+	JobSystem jobs;
+	Arena arena;
+	Ship ship;
+	AsteroidField asteroids;
+	BulletPool bullets;
+	int failures = 0;
+
+	arena_init(&arena, SESSION_ARENA_BLOCK, 0);
+	init_ship(&ship);
+
+	if (jobs_init(&jobs, 1) != 0 || asteroid_field_alloc(&asteroids, &arena, DEFAULT_ASTEROID_CAPACITY, 0) != 0) {
+
+		return 1;
+	}
+
+	bullet_pool_alloc(&bullets, &arena, MAX_TARGETS);
+	current_state = MAIN_GAME;
+
+	for (int s = 0; s < (int) (sizeof(scenes) / sizeof(scenes[0])); s++) {
+
+		const Scene *scene = &scenes[s];
+		int order[MAX_TARGETS];
+		int orders = 0;
+		int failed = 0;
+
+		for (int k = 0; k < scene->bullet_count; k++) {
+
+			order[k] = k;
+		}
+
+		do {
+
+			failed += run_scene(&jobs, &ship, &asteroids, &bullets, scene, order);
+			orders++;
+
+		} while (next_order(order, scene->bullet_count));
+
+		printf("%s: %s, %d of %d bullet orders wrong\n", failed ? "FAIL" : "ok", scene->name, failed, orders);
+		failures += failed;
+	}
+
+	free_game(&jobs, &ship, &asteroids, &arena);
+
+	return failures > 0;
+}
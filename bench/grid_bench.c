@@ -0,0 +1,164 @@
+//benchmark of the uniform grid broadphase in grid.h against brute force circle tests
+//sweeps the asteroid count and reports the cost of one collision tick for each path
+//compile from the repo root:
+//gcc -O2 bench/grid_bench.c mem.c -I. -o grid_bench -lm
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "grid.h"
+
+#define WIDTH 1920.0f
+#define HEIGHT 1080.0f
+#define TICKS 50
+
+static float *pos_x, *pos_y, *vel_x, *vel_y, *radius;
+
+static double now(void) {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static float frand(float min, float max) {
+
+	return min + ((float) rand() / (float) RAND_MAX) * (max - min);
+}
+
+static int touching(float x1, float y1, float r1, float x2, float y2, float r2) {
+
+	float dx = x1 - x2;
+	float dy = y1 - y2;
+
+	return dx * dx + dy * dy < (r1 + r2) * (r1 + r2);
+}
+
+//move every asteroid one tick and wrap it around the playfield
+static void move(int n) {
+
+	for (int i = 0; i < n; i++) {
+		
+		pos_x[i] += vel_x[i];
+		pos_y[i] += vel_y[i];
+		pos_x[i] = (pos_x[i] > WIDTH / 2) ? -WIDTH / 2 : (pos_x[i] < -WIDTH / 2) ? WIDTH / 2 : pos_x[i];
+		pos_y[i] = (pos_y[i] > HEIGHT / 2) ? -HEIGHT / 2 : (pos_y[i] < -HEIGHT / 2) ? HEIGHT / 2 : pos_y[i];
+	}
+}
+
+//the query points are a ship and a number of bullets, returns the number of hits found
+static long brute(int n, float *qx, float *qy, float *qr, int queries) {
+
+	long hits = 0;
+
+	for (int i = 0; i < n; i++) {
+		
+		for (int q = 0; q < queries; q++) {
+			
+			hits += touching(qx[q], qy[q], qr[q], pos_x[i], pos_y[i], radius[i]);
+		}
+	}
+
+	return hits;
+}
+
+static long broadphase(Grid *g, int n, float *qx, float *qy, float *qr, int queries) {
+
+	long hits = 0;
+
+	for (int i = 0; i < n; i++) {
+		
+		grid_update(g, i, pos_x[i], pos_y[i]);
+	}
+
+	for (int q = 0; q < queries; q++) {
+		
+		int count = grid_query(g, qx[q], qy[q], qr[q] + 60.0f);
+
+		for (int k = 0; k < count; k++) {
+			
+			int i = g->query[k];
+			hits += touching(qx[q], qy[q], qr[q], pos_x[i], pos_y[i], radius[i]);
+		}
+	}
+
+	return hits;
+}
+
+static void bench(int n, int queries) {
+
+	float qx[256], qy[256], qr[256];
+	Grid g;
+
+	pos_x = malloc(n * sizeof(float));
+	pos_y = malloc(n * sizeof(float));
+	vel_x = malloc(n * sizeof(float));
+	vel_y = malloc(n * sizeof(float));
+	radius = malloc(n * sizeof(float));
+
+	srand(1);
+
+	for (int i = 0; i < n; i++) {
+		
+		pos_x[i] = frand(-WIDTH / 2, WIDTH / 2);
+		pos_y[i] = frand(-HEIGHT / 2, HEIGHT / 2);
+		vel_x[i] = frand(-0.3f, 0.3f);
+		vel_y[i] = frand(-0.3f, 0.3f);
+		radius[i] = (i % 3 == 0) ? 60.0f : (i % 3 == 1) ? 30.0f : 15.0f;
+	}
+
+	//query 0 is the ship, the rest are bullets
+	for (int q = 0; q < queries; q++) {
+		
+		qx[q] = frand(-WIDTH / 2, WIDTH / 2);
+		qy[q] = frand(-HEIGHT / 2, HEIGHT / 2);
+		qr[q] = (q == 0) ? 30.0f : 0.0f;
+	}
+
+	grid_init(&g, WIDTH, HEIGHT, 120.0f, n);
+
+	long hits_brute = 0;
+	long hits_grid = 0;
+	double t_brute = 0.0;
+	double t_grid = 0.0;
+
+	for (int t = 0; t < TICKS; t++) {
+		
+		move(n);
+
+		double start = now();
+		hits_brute += brute(n, qx, qy, qr, queries);
+		double mid = now();
+		hits_grid += broadphase(&g, n, qx, qy, qr, queries);
+		double end = now();
+
+		t_brute += mid - start;
+		t_grid += end - mid;
+	}
+
+	printf("%7d asteroids %4d queries  brute %10.1f us  grid %10.1f us  (%6.2fx) %s\n", n, queries, t_brute * 1e6 / TICKS, t_grid * 1e6 / TICKS, t_brute / t_grid, (hits_brute == hits_grid) ? "hits match" : "HITS DIFFER");
+
+	grid_free(&g);
+	free(pos_x);
+	free(pos_y);
+	free(vel_x);
+	free(vel_y);
+	free(radius);
+}
+
+int main(void) {
+
+	int counts[] = {100, 1000, 10000, 100000};
+	int queries[] = {5, 65, 256};
+
+	for (int q = 0; q < 3; q++) {
+		
+		for (int c = 0; c < 4; c++) {
+			
+			bench(counts[c], queries[q]);
+		}
+	}
+
+	return 0;
+}
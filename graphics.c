@@ -5,7 +5,17 @@
 #include <X11/keysym.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <poll.h>
 #include "graphics.h"
+#include "profile.h"
+#include "xstats.h"
+#include "mem.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 #define STBI_NO_JPEG
 #define STBI_NO_GIF
 #define STBI_NO_PSD
@@ -13,12 +23,157 @@
 #define STBI_NO_PNM
 #define STBI_NO_HDR
 #define STBI_NO_TGA
+#define STBI_MALLOC(size) mem_alloc(MEM_SPRITE, size)
+#define STBI_REALLOC(p, size) mem_realloc(MEM_SPRITE, p, size)
+#define STBI_FREE(p) mem_free(p)
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #define PLY_IMPLEMENTATION
 #include "ply.h"
 
+//mark rows y0 to y1 (exclusive) of the pixel buffer as drawn to this frame
+static inline void mark_rows(App *app, int y0, int y1) {
+
+	if (app->rows_used == NULL) {
+		
+		return;
+	}
+
+	for (int y = y0; y < y1; y++) {
+		
+		app->rows_used[y / 64] |= 1ULL << (y % 64);
+	}
+}
+
+static inline int row_used(uint64_t *rows, int y) {
+
+	return (rows[y / 64] >> (y % 64)) & 1;
+}
+
 /* Function definitions */
+
+//Make the XImage, pixel buffer and row bitmaps for the current window and pixel buffer sizes. When the pixel
+//buffer is the size of the window it is the XImage data itself and raster goes straight into what is uploaded
+static int create_framebuffers(App *app) {
+
+	if (app->native_resolution) {
+		
+		app->pixel_buffer_w = app->width;
+		app->pixel_buffer_h = app->height;
+	}
+
+	if (app->pixel_buffer_w > PBUF_MAX_SIDE || app->pixel_buffer_h > PBUF_MAX_SIDE) {
+		
+		printf("pixel buffer of %dx%d is bigger than %dx%d\n", app->pixel_buffer_w, app->pixel_buffer_h, PBUF_MAX_SIDE, PBUF_MAX_SIDE);
+		return 1;
+	}
+
+	size_t pixels = (size_t) app->pixel_buffer_w * app->pixel_buffer_h;
+
+	//one bit per pixel buffer row for this frame and the last one
+	int row_words = (app->pixel_buffer_h + 63) / 64;
+	app->rows_used = (uint64_t *) mem_calloc(MEM_FRAMEBUFFER, row_words, sizeof(uint64_t));
+	app->rows_used_prev = (uint64_t *) mem_calloc(MEM_FRAMEBUFFER, row_words, sizeof(uint64_t));
+
+	if (app->rows_used == NULL || app->rows_used_prev == NULL) {
+
+		puts("error allocating row bitmaps");
+		return 1;
+	}
+
+	// Create the XImage structure at the full screen resolution
+	app->ximage = XCreateImage(app->d, DefaultVisual(app->d, app->screen), DefaultDepth(app->d, app->screen), ZPixmap, 0, NULL, app->width, app->height, 32, 0);
+
+	if (app->ximage == NULL) {
+		
+		puts("Error creating XImage");
+		return 1;
+	}
+
+	// Allocate the big memory block for the 1080p image, aligned and on huge pages where the system allows
+	size_t ximage_size = (size_t) app->ximage->bytes_per_line * app->height;
+	app->ximage->data = (char *) mem_huge_alloc(MEM_X, ximage_size);
+
+	if (app->ximage->data == NULL) {
+		
+		puts("Error allocating XImage data");
+		return 1;
+	}
+
+	//the pixel buffer can only stand in for the XImage if its rows are laid out the same way
+	app->direct = !app->indexed && app->pixel_buffer_w == app->width && app->pixel_buffer_h == app->height && app->ximage->bits_per_pixel == 32 && app->ximage->bytes_per_line == app->width * (int) sizeof(uint32_t);
+
+	//indexed mode draws 1 byte palette indices, the palette is only applied in the upscale pass
+	if (app->indexed) {
+		
+		app->index_buffer = (uint8_t *) mem_huge_alloc(MEM_FRAMEBUFFER, pixels);
+
+		if (app->index_buffer == NULL) {
+
+			puts("error allocating index buffer");
+			return 1;
+		}
+
+		memset(app->index_buffer, PAL_CLEAR, pixels);
+
+	} else if (app->direct) {
+		
+		app->pixel_buffer = (uint32_t *) app->ximage->data;
+
+	} else {
+
+		app->pixel_buffer = (uint32_t *) mem_huge_alloc(MEM_FRAMEBUFFER, pixels * sizeof(uint32_t));
+
+		if (app->pixel_buffer == NULL) {
+
+			puts("error allocating pixel buffer");
+			return 1;
+		}
+	}
+
+	//ximage memory starts out as garbage, a huge page mapping is zeroed but the fallback is not
+	memset(app->ximage->data, 0, ximage_size);
+
+	if (app->pixel_buffer != NULL && !app->direct) {
+		
+		memset(app->pixel_buffer, 0, pixels * sizeof(uint32_t));
+	}
+
+	app->ximage_stale = true;
+	app->pixels_cleared = false;
+
+	return 0;
+}
+
+//give back what create_framebuffers made, safe on a partly made set
+static void free_framebuffers(App *app) {
+
+	//in direct mode the pixel buffer is the XImage data and goes with it
+	if (!app->direct) {
+		
+		mem_free(app->pixel_buffer);
+	}
+
+	mem_free(app->index_buffer);
+	mem_free(app->rows_used);
+	mem_free(app->rows_used_prev);
+
+	//Free the XImage, its data came from mem_alloc so Xlib must not free it
+	if (app->ximage) {
+	
+		mem_free(app->ximage->data);
+		app->ximage->data = NULL;
+		XDestroyImage(app->ximage);
+	}
+
+	app->pixel_buffer = NULL;
+	app->index_buffer = NULL;
+	app->rows_used = NULL;
+	app->rows_used_prev = NULL;
+	app->ximage = NULL;
+	app->direct = false;
+}
+
 int init_x(App *app, int w, int h) {
 	
 	app->d = XOpenDisplay(NULL);
@@ -35,28 +190,22 @@ int init_x(App *app, int w, int h) {
 	app->width = w;
 	app->height = h;
 
-	//setup a width and height for a pixel buffer to manually draw into
-	app->pixel_buffer_w = PBUF_WIDTH;
-	app->pixel_buffer_h = PBUF_HEIGHT;
-	app->pixel_buffer = (uint32_t *) malloc((PBUF_WIDTH * PBUF_HEIGHT) * sizeof(uint32_t));
-
-	if (app->pixel_buffer == NULL) {
-
-		puts("error allocating pixel buffer");
-		return 1;
+	//setup a width and height for a pixel buffer to manually draw into, unless one was set before init_x
+	if (app->pixel_buffer_w <= 0 || app->pixel_buffer_h <= 0) {
+		
+		app->pixel_buffer_w = PBUF_WIDTH;
+		app->pixel_buffer_h = PBUF_HEIGHT;
 	}
 
-	// Create the XImage structure at the full screen resolution
-	app->ximage = XCreateImage(app->d, DefaultVisual(app->d, app->screen), DefaultDepth(app->d, app->screen), ZPixmap, 0, NULL, app->width, app->height, 32, 0);
-
-	// Allocate the big memory block for the 1080p image
-	app->ximage->data = (char *)malloc(app->ximage->bytes_per_line * app->height);
+	app->pixel_buffer = NULL;
+	app->index_buffer = NULL;
 
-	if (app->ximage->data == NULL) {
+	if (app->indexed) {
 		
-		puts("Error allocating XImage data");
-		return 1;
-	}	
+		app->palette_count = 0;
+		set_palette(app, PAL_CLEAR, 0x00000000);
+		set_palette(app, PAL_TEXT, TEXT_COLOUR);
+	}
 
 	//Create Window
 	app->w = XCreateSimpleWindow(app->d, RootWindow(app->d, app->screen), 10, 10, app->width, app->height, 1, BlackPixel(app->d, app->screen), BlackPixel(app->d, app->screen));
@@ -84,6 +233,11 @@ int init_x(App *app, int w, int h) {
 	
 	app->buffer = XCreatePixmap(app->d, app->w, app->width, app->height, wa.depth);
 
+	if (create_framebuffers(app) != 0) {
+		
+		return 1;
+	}
+
 	//listen for events
 	XSelectInput(app->d, app->w, ExposureMask | KeyPressMask | KeyReleaseMask | StructureNotifyMask | PointerMotionMask);
 	
@@ -93,39 +247,96 @@ int init_x(App *app, int w, int h) {
 	return 0;
 }
 
-void clear_screen(App *app, unsigned long colour) {
+//The window changed size. The XImage and back buffer are made again at the new size, along with the pixel
+//buffer, which may switch between direct and scaled mode or follow the window with a native resolution
+int resize_x(App *app, int w, int h) {
+
+	free_framebuffers(app);
+	XFreePixmap(app->d, app->buffer);
+
+	app->width = w;
+	app->height = h;
+	app->buffer = XCreatePixmap(app->d, app->w, app->width, app->height, DefaultDepth(app->d, app->screen));
+
+	return create_framebuffers(app);
+}
+
+//zero pixel buffer rows y0 to y1 that were drawn to this frame, or set them to the clear index in indexed mode
+static void clear_rows(App *app, int y0, int y1) {
+
+	for (int y = y0; y < y1; y++) {
+		
+		if (app->rows_used != NULL && !row_used(app->rows_used, y)) {
+			
+			continue;
+		}
+
+		if (app->pixel_buffer != NULL) {
+			
+			memset(&app->pixel_buffer[y * app->pixel_buffer_w], 0, app->pixel_buffer_w * sizeof(uint32_t));
+		}
+
+		if (app->index_buffer != NULL) {
+			
+			memset(&app->index_buffer[y * app->pixel_buffer_w], PAL_CLEAR, app->pixel_buffer_w);
+		}
+	}
+}
+
+//Start a frame. update_ximage clears every pixel buffer row as it scales it, so normally there is nothing
+//left to clear here, only in direct mode where the XImage is drawn into and can't be cleared until it is
+//uploaded. The back buffer pixmap is not filled either, the full frame XPutImage covers all of it
+void clear_screen(App *app) {
 	
-	//if the pixel buffer has been set, clear it when this function is called (every frame)
-	if (app->pixel_buffer != NULL) {
+	PROF_SCOPE(PROF_CLEAR);
+
+	//only rows that were drawn to last frame can hold anything, zero those and leave the rest
+	if (!app->pixels_cleared) {
 		
-		memset(app->pixel_buffer, 0, app->pixel_buffer_w * app->pixel_buffer_h * sizeof(uint32_t));
+		clear_rows(app, 0, app->pixel_buffer_h);
 	}
 
-	XSetForeground(app->d, app->gc, colour);
-	XFillRectangle(app->d, app->buffer, app->gc, 0, 0, app->width, app->height);
+	app->pixels_cleared = false;
+
+	//this frames rows become last frames rows
+	if (app->rows_used != NULL) {
+		
+		int row_words = (app->pixel_buffer_h + 63) / 64;
+		uint64_t *tmp = app->rows_used_prev;
+
+		app->rows_used_prev = app->rows_used;
+		app->rows_used = tmp;
+		memset(app->rows_used, 0, row_words * sizeof(uint64_t));
+	}
 }
 
 void flip_buffer(App *app) {
 
+	PROF_SCOPE(PROF_FLIP);
+
 	//Copy the Pixmap to the Window (The actual "Flip")
-	XCopyArea(app->d, app->buffer, app->w, app->gc, 0, 0, app->width, app->height, 0, 0);
-	XFlush(app->d);
+	x_copy_area(app->d, app->buffer, app->w, app->gc, 0, 0, app->width, app->height, 0, 0);
+	x_flush(app->d);
 }
 
-void close_x(App *app) {
-	
-	//Free the pixel buffer
-	if (app->pixel_buffer) {
-	
-		free(app->pixel_buffer);
-	}
-	
-	//Free the XImage
-	if (app->ximage) {
-	
-		XDestroyImage(app->ximage);
+//sleep until the server sends an event or seconds pass, returns true if there is an event to read
+bool wait_for_event(App *app, double seconds) {
+
+	//XPending flushes what is queued first, the server won't answer requests it never got
+	if (x_pending(app->d)) {
+		
+		return true;
 	}
 
+	struct pollfd fd = {ConnectionNumber(app->d), POLLIN, 0};
+
+	return poll(&fd, 1, (int) (seconds * 1000.0)) > 0;
+}
+
+void close_x(App *app) {
+	
+	//Free the pixel buffer and XImage
+	free_framebuffers(app);
 
 	//Free the back buffer
 	if (app->buffer) {
@@ -152,28 +363,73 @@ void close_x(App *app) {
 	}
 }
 
+//set the colour of a palette entry, changing an entry recolours every pixel drawn with it on the next update_ximage
+void set_palette(App *app, uint8_t index, uint32_t colour) {
+
+	app->palette[index] = colour;
+
+	if (index >= app->palette_count) {
+		
+		app->palette_count = index + 1;
+	}
+}
+
+//find the palette index for a colour, adding it if there is room or returning the closest entry if the palette is full
+uint8_t palette_index(App *app, uint32_t colour) {
+
+	int best = 0;
+	int best_dist = 0x7fffffff;
+
+	for (int i = 0; i < app->palette_count; i++) {
+		
+		if (app->palette[i] == colour) {
+			
+			return i;
+		}
+
+		int dr = (int) ((app->palette[i] >> 16) & 0xFF) - (int) ((colour >> 16) & 0xFF);
+		int dg = (int) ((app->palette[i] >> 8) & 0xFF) - (int) ((colour >> 8) & 0xFF);
+		int db = (int) (app->palette[i] & 0xFF) - (int) (colour & 0xFF);
+		int dist = dr * dr + dg * dg + db * db;
+
+		if (dist < best_dist) {
+			
+			best = i;
+			best_dist = dist;
+		}
+	}
+
+	if (app->palette_count < 256) {
+		
+		set_palette(app, app->palette_count, colour);
+		return app->palette_count - 1;
+	}
+
+	return best;
+}
+
 void draw_line(App *app, int x1, int y1, int x2, int y2, unsigned long colour) {
 
-	XSetForeground(app->d, app->gc, colour);
+	x_set_foreground(app->d, app->gc, colour);
 	
 	// LineSolid = 0, CapButt = 1, JoinMiter = 0
 	//XSetLineAttributes(app->d, app->gc, 4, LineSolid, CapButt, JoinMiter);
-	XSetLineAttributes(app->d, app->gc, 2, LineSolid, CapRound, JoinRound);
+	x_set_line_attributes(app->d, app->gc, 2, LineSolid, CapRound, JoinRound);
 
 	// This draws directly to your back-buffer Pixmap
-	XDrawLine(app->d, app->buffer, app->gc, x1, y1, x2, y2);
+	x_draw_line(app->d, app->buffer, app->gc, x1, y1, x2, y2);
 }
 
 void draw_arc(App *app, int x, int y, unsigned int width, unsigned int height, int angle1, int angle2, unsigned long colour) {
 
-	XSetForeground(app->d, app->gc, colour);
-	XFillArc(app->d, app->buffer, app->gc, x, y, width, height, angle1, angle2);
+	x_set_foreground(app->d, app->gc, colour);
+	x_fill_arc(app->d, app->buffer, app->gc, x, y, width, height, angle1, angle2);
 }
 
 void toggle_fullscreen(App *app) {
     
-	Atom wm_state = XInternAtom(app->d, "_NET_WM_STATE", False);
-	Atom fullscreen = XInternAtom(app->d, "_NET_WM_STATE_FULLSCREEN", False);
+	Atom wm_state = x_intern_atom(app->d, "_NET_WM_STATE", False);
+	Atom fullscreen = x_intern_atom(app->d, "_NET_WM_STATE_FULLSCREEN", False);
 	XEvent xev = {0};
 	xev.type = ClientMessage;
 	xev.xclient.window = app->w;
@@ -187,6 +443,9 @@ void toggle_fullscreen(App *app) {
 //open image file an store in a ARGB buffer that can be read by xlib
 int load_sprite(Sprite *s, char *filename) {
 
+	//sprite_build_spans reallocates and frees what the sprite holds, start it out empty
+	*s = (Sprite) {0};
+
 	//force 4 channels (RGBA) even if the source is RGB
 	unsigned char *data = stbi_load(filename, &s->width, &s->height, &s->channels, 4);
 
@@ -199,7 +458,7 @@ int load_sprite(Sprite *s, char *filename) {
 
 	//allocate a pixel buffer to store the sprite data in ARGB which is expected by xlib and the screenbuffer
 	int total_pixels = s->width * s->height;
-	s->pixels = (uint32_t *) malloc(total_pixels * sizeof(uint32_t));
+	s->pixels = (uint32_t *) mem_alloc(MEM_SPRITE, total_pixels * sizeof(uint32_t));
 	
 	if (s->pixels == NULL) {
 		
@@ -223,138 +482,922 @@ int load_sprite(Sprite *s, char *filename) {
 	//free the un-needed image data loaded by stb_image
 	stbi_image_free(data);
 
-	return 0;
+	return sprite_build_spans(s);
 }
 
-//loads a bitmapped font into a sprite and defines each chars width and height
-void load_font(Fontmap *fontmap, char *filename, char *f_map, int char_width, int char_height) {
-
-	load_sprite(&fontmap->font_buffer, filename);
-	fontmap->f_map = f_map;
-	fontmap->char_width = 8;
-	fontmap->char_height = 16;
-}
+//find the opaque runs of every row and fill the premultiplied copy
+//the buffers must already have room for the sprite, nothing is allocated
+static void sprite_scan(Sprite *s) {
 
-//draw sprite to screen buffer
-void draw_sprite(App *app, Sprite *s, int start_x, int start_y) {
+	int total_pixels = s->width * s->height;
+	int count = 0;
 
 	for (int y = 0; y < s->height; y++) {
+		
+		uint32_t *row = &s->pixels[y * s->width];
+		int x = 0;
 
-		for (int x = 0; x < s->width; x++) {
+		s->row_spans[y] = count;
 
-			//determine where we are on the screen
-			int screen_x = start_x + x;
-			int screen_y = start_y + y;
+		while (x < s->width) {
+			
+			//skip transparent pixels
+			while (x < s->width && (row[x] & 0xFF000000) == 0) {
+				
+				x++;
+			}
 
-			//safety Check (Clipping) don't draw if we are off-screen!
-			if (screen_x >= 0 && screen_x < app->pixel_buffer_w && screen_y >= 0 && screen_y < app->pixel_buffer_h) {
+			int start = x;
 
-				//Get the color from the sprite
-				uint32_t color = s->pixels[y * s->width + x];
+			while (x < s->width && (row[x] & 0xFF000000) != 0) {
+				
+				x++;
+			}
 
-				//Alpha Check (Transparency) Only draw if the Alpha byte isn't 0
-				if ((color & 0xFF000000) != 0) {
-			
-					// Calculate index in the big screen buffer
-					int screen_index = screen_y * app->pixel_buffer_w + screen_x;
-					app->pixel_buffer[screen_index] = color;
-				}
+			if (x > start) {
+				
+				s->spans[count++] = (SpriteSpan) {start, x - start};
 			}
 		}
 	}
+
+	s->row_spans[s->height] = count;
+	s->indices_stale = true;
+
+	for (int i = 0; i < total_pixels; i++) {
+		
+		uint32_t c = s->pixels[i];
+		uint32_t a = c >> 24;
+		uint32_t r = (((c >> 16) & 0xFF) * a + 127) / 255;
+		uint32_t g = (((c >> 8) & 0xFF) * a + 127) / 255;
+		uint32_t b = ((c & 0xFF) * a + 127) / 255;
+
+		s->premul[i] = (a << 24) | (r << 16) | (g << 8) | b;
+	}
 }
 
-//this function takes a Fontmap struct and draws a single char from a sprite sheet contained within the font map
-void draw_char(App *app, Fontmap *f, int start_x, int start_y, char c) {
-	
-	char *cp = strchr(f->f_map, c);	//get pointer to first occurrence of char
-	int index = 0;			//default to 0 if not found
+//scan the sprite for runs of opaque pixels and build a premultiplied copy for blending
+//call this again whenever the sprites pixels change
+int sprite_build_spans(Sprite *s) {
 
-	if (cp != NULL) {
+	int total_pixels = s->width * s->height;
 	
-		index = (int) (cp - f->f_map);
+	//worst case every other pixel is opaque
+	int max_spans = s->height * ((s->width + 1) / 2);
+	SpriteSpan *spans = (SpriteSpan *) mem_realloc(MEM_SPRITE, s->spans, (max_spans > 0 ? max_spans : 1) * sizeof(SpriteSpan));
+	int *row_spans = (int *) mem_realloc(MEM_SPRITE, s->row_spans, (s->height + 1) * sizeof(int));
+	uint32_t *premul = (uint32_t *) mem_realloc(MEM_SPRITE, s->premul, (total_pixels > 0 ? total_pixels : 1) * sizeof(uint32_t));
+
+	if (spans == NULL || row_spans == NULL || premul == NULL) {
+		
+		puts("could not allocate memory for sprite spans");
+		s->spans = spans;
+		s->row_spans = row_spans;
+		s->premul = premul;
+		
+		return 1;
 	}
 
-	int col = f->font_buffer.width / f->char_width;	//number of columns in spritesheet
-	int row = index / col;				//row the char was found on
-	int px = (index % col) * f->char_width;		//X pixel position of the char in the spritesheet
-	int py = row * f->char_height;			//Y pixel position of the char in the spritesheet
+	s->spans = spans;
+	s->row_spans = row_spans;
+	s->premul = premul;
 
-	for (int y = 0; y < f->char_height; y++) {
+	sprite_scan(s);
+
+	//pixels changed so any palette indices are stale
+	mem_free(s->indices);
+	s->indices = NULL;
+
+	return 0;
+}
+
+void sprite_free(Sprite *s) {
+
+	mem_free(s->pixels);
+	mem_free(s->spans);
+	mem_free(s->row_spans);
+	mem_free(s->premul);
+	mem_free(s->indices);
+	*s = (Sprite) {0};
+}
+
+//loads a bitmapped font into a sprite and defines each chars width and height
+//the sheet is then converted to 1 bit glyph masks and a char lookup table so drawing text never touches the ARGB sheet
+void load_font(Fontmap *fontmap, char *filename, char *f_map, int char_width, int char_height) {
+
+	*fontmap = (Fontmap) {0};
+	fontmap->f_map = f_map;
+	fontmap->char_width = char_width;
+	fontmap->char_height = char_height;
+	fontmap->row_bytes = (char_width + 7) / 8;
+
+	if (load_sprite(&fontmap->font_buffer, filename) != 0) {
 		
-		for (int x = 0; x < f->char_width; x++) {
+		return;
+	}
+
+	//build the char to glyph lookup table, walk backwards so the first occurrence of a char wins (same as strchr)
+	int len = strlen(f_map);
+
+	for (int i = len - 1; i >= 0; i--) {
 		
-			//Where to read from the sheet (Source)
-			//We start at the char's corner (px, py) and add our loop offsets
-			int src_x = px + x;
-			int src_y = py + y;
-			uint32_t color = f->font_buffer.pixels[src_y * f->font_buffer.width + src_x];
+		fontmap->glyph_index[(unsigned char) f_map[i]] = i;
+	}
+
+	int cols = fontmap->font_buffer.width / char_width;	//number of columns in spritesheet
+	int rows = fontmap->font_buffer.height / char_height;	//number of rows in spritesheet
+	fontmap->glyph_count = cols * rows;
+	fontmap->glyph_masks = (uint8_t *) mem_calloc(MEM_SPRITE, fontmap->glyph_count * char_height * fontmap->row_bytes, 1);
 
-			//Where to draw on the screen (Destination)
-			int screen_x = start_x + x;
-			int screen_y = start_y + y;
+	if (fontmap->glyph_masks == NULL) {
+		
+		printf("could not allocate glyph masks for font: %s\n", filename);
+		fontmap->glyph_count = 0;
+		
+		return;
+	}
 
-			//Safety Check (Clipping)
-			//Never draw off the screen buffer!
-			if (screen_x >= 0 && screen_x < app->pixel_buffer_w && screen_y >= 0 && screen_y < app->pixel_buffer_h) {
+	//pack every cell of the sheet, a set bit is a white texel
+	for (int g = 0; g < fontmap->glyph_count; g++) {
+		
+		int px = (g % cols) * char_width;	//X pixel position of the char in the spritesheet
+		int py = (g / cols) * char_height;	//Y pixel position of the char in the spritesheet
+		uint8_t *mask = &fontmap->glyph_masks[g * char_height * fontmap->row_bytes];
 
-				int screen_index = screen_y * app->pixel_buffer_w + screen_x;
+		for (int y = 0; y < char_height; y++) {
+			
+			uint32_t *src = &fontmap->font_buffer.pixels[(py + y) * fontmap->font_buffer.width + px];
 
-				if (color == 0xffffffff) {
+			for (int x = 0; x < char_width; x++) {
 				
-					app->pixel_buffer[screen_index] = 0xff00ff00;
+				if (src[x] == 0xffffffff) {
+					
+					mask[y * fontmap->row_bytes + x / 8] |= 1 << (x % 8);
 				}
 			}
 		}
 	}
 }
 
-//this function takes a string and draws it to the screen buffer at a X,Y coordinate
-void draw_string(App *app, Fontmap *fm, char *str, int x, int y) {
+void font_free(Fontmap *fontmap) {
 
-	int len = strlen(str);
+	sprite_free(&fontmap->font_buffer);
+	mem_free(fontmap->glyph_masks);
+	fontmap->glyph_masks = NULL;
+	fontmap->glyph_count = 0;
+}
 
-	for (int i = 0; i < len; i++) {
+//map every pixel of a sprite to a palette index for drawing in indexed mode
+static int sprite_build_indices(App *app, Sprite *s) {
+
+	int total_pixels = s->width * s->height;
+
+	//text runs allocate theirs up front with room for their longest string, so only fill them
+	if (s->indices == NULL) {
 		
-		int xoff = i * fm->char_width + x;
+		s->indices = (uint8_t *) mem_alloc(MEM_SPRITE, total_pixels > 0 ? total_pixels : 1);
+	}
 
-		draw_char(app, fm, xoff, y, str[i]);
+	if (s->indices == NULL) {
+		
+		puts("could not allocate memory for sprite indices");
+		return 1;
 	}
-}
 
-//copy the buffer to a Ximage and scale it to the screen size
-void update_ximage(App *app) {
+	s->indices_stale = false;
 
-	// Calculate how many screen pixels one buffer pixel occupies
-	float scale_x = (float)app->width / app->pixel_buffer_w;
-	float scale_y = (float)app->height / app->pixel_buffer_h;
+	//sprites only use a few colours, so remember the last lookup
+	uint32_t last = 0;
+	uint8_t last_index = palette_index(app, 0);
 
-	for (int y = 0; y < app->height; y++) {
+	for (int i = 0; i < total_pixels; i++) {
+		
+		if (s->pixels[i] != last) {
+			
+			last = s->pixels[i];
+			last_index = palette_index(app, last);
+		}
 
-		// Map current screen row back to the source buffer row
-		int src_y = (int)(y / scale_y);
-		uint32_t *src_row = &app->pixel_buffer[src_y * app->pixel_buffer_w];
+		s->indices[i] = last_index;
+	}
 
-		// Get the destination row in the XImage
-		uint32_t *dest_row = (uint32_t *)(app->ximage->data + (y * app->ximage->bytes_per_line));
+	return 0;
+}
 
-		for (int x = 0; x < app->width; x++) {
-			// Map current screen column back to the source buffer column
-			int src_x = (int)(x / scale_x);
-	
-			// "Sample" the color from the buffer and drop it into the screen
-			dest_row[x] = src_row[src_x];
-		}
+//draw sprite to screen buffer
+//the sprite is clipped against the buffer once, then each opaque span of a row is copied in one move
+void draw_sprite(App *app, Sprite *s, int start_x, int start_y) {
+
+	if (s->row_spans == NULL && sprite_build_spans(s) != 0) {
+		
+		return;
 	}
-	
-	// Upload the XImage (CPU RAM) to the Pixmap (X Server/VRAM) This takes whatever is in ximage->data and puts it in the Pixmap 
-	XPutImage(app->d, app->buffer, app->gc, app->ximage, 0, 0, 0, 0, app->width, app->height);	
-}
 
-void draw_pixel_buffer(App *app) {
-	
-	//fill the pixel_buffer with random data
-	for (int i = 0; i < (app->pixel_buffer_w * app->pixel_buffer_h); i++) {
+	if (app->indexed && (s->indices == NULL || s->indices_stale) && sprite_build_indices(app, s) != 0) {
+		
+		return;
+	}
+
+	//visible part of the sprite in sprite space
+	int x0 = (start_x < 0) ? -start_x : 0;
+	int y0 = (start_y < 0) ? -start_y : 0;
+	int x1 = (start_x + s->width > app->pixel_buffer_w) ? app->pixel_buffer_w - start_x : s->width;
+	int y1 = (start_y + s->height > app->pixel_buffer_h) ? app->pixel_buffer_h - start_y : s->height;
+
+	mark_rows(app, start_y + y0, start_y + y1);
+
+	if (app->indexed) {
+		
+		for (int y = y0; y < y1; y++) {
+			
+			uint8_t *src = &s->indices[y * s->width];
+			uint8_t *dest = &app->index_buffer[(start_y + y) * app->pixel_buffer_w + start_x];
+
+			for (int i = s->row_spans[y]; i < s->row_spans[y + 1]; i++) {
+				
+				int a = s->spans[i].start;
+				int b = a + s->spans[i].len;
+
+				a = (a < x0) ? x0 : a;
+				b = (b > x1) ? x1 : b;
+
+				if (a < b) {
+					
+					memcpy(&dest[a], &src[a], b - a);
+				}
+			}
+		}
+
+		return;
+	}
+
+	for (int y = y0; y < y1; y++) {
+		
+		uint32_t *src = &s->pixels[y * s->width];
+		uint32_t *dest = &app->pixel_buffer[(start_y + y) * app->pixel_buffer_w + start_x];
+
+		for (int i = s->row_spans[y]; i < s->row_spans[y + 1]; i++) {
+			
+			int a = s->spans[i].start;
+			int b = a + s->spans[i].len;
+
+			a = (a < x0) ? x0 : a;
+			b = (b > x1) ? x1 : b;
+
+			if (a < b) {
+				
+				memcpy(&dest[a], &src[a], (b - a) * sizeof(uint32_t));
+			}
+		}
+	}
+}
+
+//premultiplied "over" for one pixel, dest = src + dest * (255 - src_alpha) / 255
+static inline uint32_t blend_pixel(uint32_t src, uint32_t dest) {
+
+	uint32_t ia = 255 - (src >> 24);
+	uint32_t out = 0;
+
+	for (int shift = 0; shift < 32; shift += 8) {
+		
+		uint32_t t = ((dest >> shift) & 0xFF) * ia + 128;
+
+		out |= (((src >> shift) & 0xFF) + ((t + (t >> 8)) >> 8)) << shift;
+	}
+
+	return out;
+}
+
+#ifdef __SSE2__
+//blend 4 premultiplied pixels over dest, the divide by 255 is done as (t + 128 + ((t + 128) >> 8)) >> 8
+static inline __m128i blend4_sse2(__m128i src, __m128i dest) {
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i c255 = _mm_set1_epi16(255);
+	const __m128i c128 = _mm_set1_epi16(128);
+
+	__m128i s_lo = _mm_unpacklo_epi8(src, zero);
+	__m128i s_hi = _mm_unpackhi_epi8(src, zero);
+	__m128i d_lo = _mm_unpacklo_epi8(dest, zero);
+	__m128i d_hi = _mm_unpackhi_epi8(dest, zero);
+
+	//broadcast each pixels alpha to all 4 of its channels
+	__m128i ia_lo = _mm_sub_epi16(c255, _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_lo, 0xFF), 0xFF));
+	__m128i ia_hi = _mm_sub_epi16(c255, _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_hi, 0xFF), 0xFF));
+
+	d_lo = _mm_add_epi16(_mm_mullo_epi16(d_lo, ia_lo), c128);
+	d_hi = _mm_add_epi16(_mm_mullo_epi16(d_hi, ia_hi), c128);
+	d_lo = _mm_srli_epi16(_mm_add_epi16(d_lo, _mm_srli_epi16(d_lo, 8)), 8);
+	d_hi = _mm_srli_epi16(_mm_add_epi16(d_hi, _mm_srli_epi16(d_hi, 8)), 8);
+
+	return _mm_packus_epi16(_mm_add_epi16(d_lo, s_lo), _mm_add_epi16(d_hi, s_hi));
+}
+#endif
+
+#ifdef __AVX2__
+//same as blend4_sse2 but for 8 pixels, unpack and pack both work per 128 bit lane so pixel order is kept
+static inline __m256i blend8_avx2(__m256i src, __m256i dest) {
+
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i c255 = _mm256_set1_epi16(255);
+	const __m256i c128 = _mm256_set1_epi16(128);
+
+	__m256i s_lo = _mm256_unpacklo_epi8(src, zero);
+	__m256i s_hi = _mm256_unpackhi_epi8(src, zero);
+	__m256i d_lo = _mm256_unpacklo_epi8(dest, zero);
+	__m256i d_hi = _mm256_unpackhi_epi8(dest, zero);
+
+	__m256i ia_lo = _mm256_sub_epi16(c255, _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s_lo, 0xFF), 0xFF));
+	__m256i ia_hi = _mm256_sub_epi16(c255, _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s_hi, 0xFF), 0xFF));
+
+	d_lo = _mm256_add_epi16(_mm256_mullo_epi16(d_lo, ia_lo), c128);
+	d_hi = _mm256_add_epi16(_mm256_mullo_epi16(d_hi, ia_hi), c128);
+	d_lo = _mm256_srli_epi16(_mm256_add_epi16(d_lo, _mm256_srli_epi16(d_lo, 8)), 8);
+	d_hi = _mm256_srli_epi16(_mm256_add_epi16(d_hi, _mm256_srli_epi16(d_hi, 8)), 8);
+
+	return _mm256_packus_epi16(_mm256_add_epi16(d_lo, s_lo), _mm256_add_epi16(d_hi, s_hi));
+}
+#endif
+
+//blend a run of premultiplied pixels over dest
+static inline void blend_span(uint32_t *dest, const uint32_t *src, int n) {
+
+	int i = 0;
+
+#ifdef __AVX2__
+	for (; i + 8 <= n; i += 8) {
+		
+		__m256i s = _mm256_loadu_si256((const __m256i *) &src[i]);
+		__m256i d = _mm256_loadu_si256((const __m256i *) &dest[i]);
+		_mm256_storeu_si256((__m256i *) &dest[i], blend8_avx2(s, d));
+	}
+#endif
+#ifdef __SSE2__
+	for (; i + 4 <= n; i += 4) {
+		
+		__m128i s = _mm_loadu_si128((const __m128i *) &src[i]);
+		__m128i d = _mm_loadu_si128((const __m128i *) &dest[i]);
+		_mm_storeu_si128((__m128i *) &dest[i], blend4_sse2(s, d));
+	}
+#endif
+	for (; i < n; i++) {
+		
+		dest[i] = blend_pixel(src[i], dest[i]);
+	}
+}
+
+//draw sprite to screen buffer with full alpha blending using the premultiplied copy of the sprite
+//there is nothing to blend between in indexed mode so the sprite is drawn opaque
+void draw_sprite_blend(App *app, Sprite *s, int start_x, int start_y) {
+
+	if (app->indexed) {
+		
+		draw_sprite(app, s, start_x, start_y);
+		return;
+	}
+
+	if (s->row_spans == NULL && sprite_build_spans(s) != 0) {
+		
+		return;
+	}
+
+	int x0 = (start_x < 0) ? -start_x : 0;
+	int y0 = (start_y < 0) ? -start_y : 0;
+	int x1 = (start_x + s->width > app->pixel_buffer_w) ? app->pixel_buffer_w - start_x : s->width;
+	int y1 = (start_y + s->height > app->pixel_buffer_h) ? app->pixel_buffer_h - start_y : s->height;
+
+	mark_rows(app, start_y + y0, start_y + y1);
+
+	for (int y = y0; y < y1; y++) {
+		
+		uint32_t *src = &s->premul[y * s->width];
+		uint32_t *dest = &app->pixel_buffer[(start_y + y) * app->pixel_buffer_w + start_x];
+
+		for (int i = s->row_spans[y]; i < s->row_spans[y + 1]; i++) {
+			
+			int a = s->spans[i].start;
+			int b = a + s->spans[i].len;
+
+			a = (a < x0) ? x0 : a;
+			b = (b > x1) ? x1 : b;
+
+			if (a < b) {
+				
+				blend_span(&dest[a], &src[a], b - a);
+			}
+		}
+	}
+}
+
+//expand 8 bits of a glyph row into 8 pixels, set bits are written with colour and clear bits leave the pixel untouched
+static inline void expand_mask8(uint32_t *dest, uint8_t bits, uint32_t colour) {
+
+#ifdef __SSE2__
+	const __m128i lo_bits = _mm_setr_epi32(1, 2, 4, 8);
+	const __m128i hi_bits = _mm_setr_epi32(16, 32, 64, 128);
+	__m128i b = _mm_set1_epi32(bits);
+	__m128i c = _mm_set1_epi32(colour);
+
+	//turn each bit into a full 32 bit lane mask
+	__m128i m0 = _mm_cmpeq_epi32(_mm_and_si128(b, lo_bits), lo_bits);
+	__m128i m1 = _mm_cmpeq_epi32(_mm_and_si128(b, hi_bits), hi_bits);
+
+	__m128i d0 = _mm_loadu_si128((__m128i *) dest);
+	__m128i d1 = _mm_loadu_si128((__m128i *) (dest + 4));
+	d0 = _mm_or_si128(_mm_and_si128(m0, c), _mm_andnot_si128(m0, d0));
+	d1 = _mm_or_si128(_mm_and_si128(m1, c), _mm_andnot_si128(m1, d1));
+	_mm_storeu_si128((__m128i *) dest, d0);
+	_mm_storeu_si128((__m128i *) (dest + 4), d1);
+#else
+	for (int x = 0; x < 8; x++) {
+		
+		if (bits & (1 << x)) {
+			
+			dest[x] = colour;
+		}
+	}
+#endif
+}
+
+//this function takes a Fontmap struct and draws a single char from the packed glyph masks built by load_font
+void draw_char(App *app, Fontmap *f, int start_x, int start_y, char c) {
+	
+	int index = f->glyph_index[(unsigned char) c];	//defaults to 0 if not found
+
+	if (index >= f->glyph_count) {
+		
+		return;
+	}
+
+	uint8_t *mask = &f->glyph_masks[index * f->char_height * f->row_bytes];
+
+	mark_rows(app, CLAMP(start_y, 0, app->pixel_buffer_h), CLAMP(start_y + f->char_height, 0, app->pixel_buffer_h));
+
+	for (int y = 0; y < f->char_height; y++) {
+		
+		int screen_y = start_y + y;
+
+		//Safety Check (Clipping) Never draw off the screen buffer!
+		if (screen_y < 0 || screen_y >= app->pixel_buffer_h) {
+			
+			continue;
+		}
+
+		for (int b = 0; b < f->row_bytes; b++) {
+			
+			uint8_t bits = mask[y * f->row_bytes + b];
+			int screen_x = start_x + b * 8;
+
+			if (bits == 0) {
+				
+				continue;
+			}
+
+			if (app->indexed) {
+				
+				uint8_t *dest = &app->index_buffer[screen_y * app->pixel_buffer_w];
+
+				for (int x = 0; x < 8; x++) {
+					
+					if ((bits & (1 << x)) && screen_x + x >= 0 && screen_x + x < app->pixel_buffer_w) {
+						
+						dest[screen_x + x] = PAL_TEXT;
+					}
+				}
+
+				continue;
+			}
+
+			uint32_t *dest_row = &app->pixel_buffer[screen_y * app->pixel_buffer_w];
+
+			//whole 8 pixel block is on screen, expand it in one go
+			if (screen_x >= 0 && screen_x + 8 <= app->pixel_buffer_w) {
+				
+				expand_mask8(&dest_row[screen_x], bits, TEXT_COLOUR);
+				continue;
+			}
+
+			//block straddles the edge of the buffer, clip per pixel
+			for (int x = 0; x < 8; x++) {
+				
+				if ((bits & (1 << x)) && screen_x + x >= 0 && screen_x + x < app->pixel_buffer_w) {
+					
+					dest_row[screen_x + x] = TEXT_COLOUR;
+				}
+			}
+		}
+	}
+}
+
+//this function takes a string and draws it to the screen buffer at a X,Y coordinate
+void draw_string(App *app, Fontmap *fm, char *str, int x, int y) {
+
+	PROF_SCOPE(PROF_TEXT);
+	int len = strlen(str);
+
+	for (int i = 0; i < len; i++) {
+		
+		int xoff = i * fm->char_width + x;
+
+		draw_char(app, fm, xoff, y, str[i]);
+	}
+}
+
+//rasterize a single glyph into a cell of a text run sprite
+static void text_run_render_glyph(TextRun *run, int i) {
+
+	Fontmap *f = run->font;
+	int index = f->glyph_index[(unsigned char) run->text[i]];
+	uint8_t *mask = (index < f->glyph_count) ? &f->glyph_masks[index * f->char_height * f->row_bytes] : NULL;
+
+	for (int y = 0; y < f->char_height; y++) {
+		
+		uint32_t *dest = &run->sprite.pixels[y * run->sprite.width + i * f->char_width];
+
+		for (int x = 0; x < f->char_width; x++) {
+			
+			int set = mask != NULL && (mask[y * f->row_bytes + x / 8] & (1 << (x % 8)));
+			dest[x] = set ? TEXT_COLOUR : 0;
+		}
+	}
+}
+
+//size the sprite of a run for strings up to chars long in fm, text_run_set then redraws the run without allocating
+//until a longer string or another font comes along. Returns 1 if the buffers can't be allocated, the run is left empty
+int text_run_reserve(TextRun *run, Fontmap *fm, int chars) {
+
+	chars = (chars < 1) ? 1 : chars;
+	chars = (chars >= TEXT_RUN_MAX) ? TEXT_RUN_MAX - 1 : chars;
+
+	if (run->font == fm && run->capacity >= chars) {
+		
+		return 0;
+	}
+
+	bool pinned = run->pinned;
+	int width = chars * fm->char_width;
+	int total_pixels = width * fm->char_height;
+	Sprite *s = &run->sprite;
+
+	text_run_free(run);
+	run->pinned = pinned;
+
+	//worst case every other pixel is opaque, the indices are made here too so indexed mode only has to fill them
+	s->pixels = (uint32_t *) mem_alloc(MEM_SPRITE, total_pixels * sizeof(uint32_t));
+	s->spans = (SpriteSpan *) mem_alloc(MEM_SPRITE, fm->char_height * ((width + 1) / 2) * sizeof(SpriteSpan));
+	s->row_spans = (int *) mem_alloc(MEM_SPRITE, (fm->char_height + 1) * sizeof(int));
+	s->premul = (uint32_t *) mem_alloc(MEM_SPRITE, total_pixels * sizeof(uint32_t));
+	s->indices = (uint8_t *) mem_alloc(MEM_SPRITE, total_pixels);
+
+	if (s->pixels == NULL || s->spans == NULL || s->row_spans == NULL || s->premul == NULL || s->indices == NULL) {
+		
+		puts("could not allocate memory for text run");
+		text_run_free(run);
+		run->pinned = pinned;
+
+		return 1;
+	}
+
+	run->font = fm;
+	run->capacity = chars;
+
+	return 0;
+}
+
+//render a string into a text run, only glyphs that differ from the last string are re-rendered
+//returns 1 if the run had to grow and couldn't, the run is left empty and draws nothing
+int text_run_set(TextRun *run, Fontmap *fm, char *str) {
+
+	int len = strlen(str);
+	Sprite *s = &run->sprite;
+
+	if (len >= TEXT_RUN_MAX) {
+		
+		len = TEXT_RUN_MAX - 1;
+	}
+
+	if (text_run_reserve(run, fm, len) != 0) {
+		
+		return 1;
+	}
+
+	//a new length changes the sprite width so every glyph has to be rendered again
+	if (run->len != len || s->width == 0) {
+		
+		run->len = len;
+		s->width = (len > 0 ? len : 1) * fm->char_width;
+		s->height = fm->char_height;
+		s->channels = 4;
+		memset(s->pixels, 0, s->width * s->height * sizeof(uint32_t));
+		memcpy(run->text, str, len);
+		run->text[len] = '\0';
+
+		for (int i = 0; i < len; i++) {
+			
+			text_run_render_glyph(run, i);
+		}
+
+		sprite_scan(s);
+
+		return 0;
+	}
+
+	int changed = 0;
+
+	for (int i = 0; i < len; i++) {
+		
+		if (run->text[i] != str[i]) {
+			
+			run->text[i] = str[i];
+			text_run_render_glyph(run, i);
+			changed = 1;
+		}
+	}
+
+	//the spans and premultiplied copy are rebuilt in the buffers the run already has
+	if (changed) {
+		
+		sprite_scan(s);
+	}
+
+	return 0;
+}
+
+void text_run_free(TextRun *run) {
+
+	sprite_free(&run->sprite);
+	*run = (TextRun) {0};
+}
+
+//runs of static strings, filled by text_run_get and draw_string_cached
+static TextRun cache[TEXT_RUN_CACHE];
+static int next_evict = 0;
+
+//find the cached run for str, rendering it into a free or the oldest unpinned slot the first time
+//returns NULL for a string too long to cache whole or when every slot is pinned
+static TextRun *text_run_lookup(Fontmap *fm, char *str, bool pin) {
+
+	TextRun *slot = NULL;
+
+	if (strlen(str) >= TEXT_RUN_MAX) {
+		
+		return NULL;
+	}
+
+	for (int i = 0; i < TEXT_RUN_CACHE; i++) {
+		
+		if (cache[i].font == fm && strcmp(cache[i].text, str) == 0) {
+			
+			cache[i].pinned |= pin;
+			return &cache[i];
+		}
+
+		if (slot == NULL && cache[i].font == NULL) {
+			
+			slot = &cache[i];
+		}
+	}
+
+	//cache is full, reuse the oldest slot nobody holds on to
+	for (int i = 0; slot == NULL && i < TEXT_RUN_CACHE; i++) {
+		
+		TextRun *oldest = &cache[next_evict];
+
+		next_evict = (next_evict + 1) % TEXT_RUN_CACHE;
+		slot = oldest->pinned ? NULL : oldest;
+	}
+
+	if (slot == NULL) {
+		
+		return NULL;
+	}
+
+	if (text_run_set(slot, fm, str) != 0) {
+		
+		return NULL;
+	}
+
+	slot->pinned = pin;
+
+	return slot;
+}
+
+//get the run for a static string to keep and draw every frame, it stays valid until text_run_cache_free
+//returns NULL if the string is longer than TEXT_RUN_MAX - 1 chars or the cache is full of pinned runs
+TextRun *text_run_get(Fontmap *fm, char *str) {
+
+	return text_run_lookup(fm, str, true);
+}
+
+//free every cached run, pointers text_run_get handed out are no longer valid
+void text_run_cache_free(void) {
+
+	for (int i = 0; i < TEXT_RUN_CACHE; i++) {
+		
+		text_run_free(&cache[i]);
+	}
+
+	next_evict = 0;
+}
+
+//blit a text run to the screen buffer
+void draw_text_run(App *app, TextRun *run, int x, int y) {
+
+	PROF_SCOPE(PROF_TEXT);
+
+	//a run that failed to render has no buffers
+	if (run->font == NULL) {
+		
+		return;
+	}
+
+	draw_sprite(app, &run->sprite, x, y);
+}
+
+//draw a string through the text run cache, use this for strings that do not change between frames
+//strings that can't be cached are drawn glyph by glyph, strings that change every frame belong in their own run from text_run_set
+void draw_string_cached(App *app, Fontmap *fm, char *str, int x, int y) {
+
+	TextRun *run = text_run_lookup(fm, str, false);
+
+	if (run == NULL) {
+		
+		draw_string(app, fm, str, x, y);
+		return;
+	}
+
+	draw_text_run(app, run, x, y);
+}
+
+//widen a pixel buffer row by a whole factor of 2 or 4, each source pixel is repeated factor times
+//dest must be 16 byte aligned, framebuffers come from mem_huge_alloc so whole rows are whenever the row pitch is
+static void scale_row(uint32_t *dest, const uint32_t *src, int src_w, int factor) {
+
+	int i = 0;
+
+#ifdef __SSE2__
+	if (factor == 2) {
+		
+		for (; i + 4 <= src_w; i += 4) {
+			
+			__m128i s = _mm_loadu_si128((const __m128i *) &src[i]);
+
+			_mm_store_si128((__m128i *) &dest[i * 2], _mm_unpacklo_epi32(s, s));
+			_mm_store_si128((__m128i *) &dest[i * 2 + 4], _mm_unpackhi_epi32(s, s));
+		}
+
+	} else if (factor == 4) {
+		
+		for (; i + 4 <= src_w; i += 4) {
+			
+			__m128i s = _mm_loadu_si128((const __m128i *) &src[i]);
+
+			_mm_store_si128((__m128i *) &dest[i * 4], _mm_shuffle_epi32(s, 0x00));
+			_mm_store_si128((__m128i *) &dest[i * 4 + 4], _mm_shuffle_epi32(s, 0x55));
+			_mm_store_si128((__m128i *) &dest[i * 4 + 8], _mm_shuffle_epi32(s, 0xAA));
+			_mm_store_si128((__m128i *) &dest[i * 4 + 12], _mm_shuffle_epi32(s, 0xFF));
+		}
+	}
+#endif
+
+	for (; i < src_w; i++) {
+		
+		for (int k = 0; k < factor; k++) {
+			
+			dest[i * factor + k] = src[i];
+		}
+	}
+}
+
+//copy the buffer to a Ximage and scale it to the screen size
+void update_ximage(App *app) {
+
+	double start = prof_now();
+
+	//raster already went straight into the XImage, there is nothing to scale and clear_screen clears the drawn rows
+	if (app->direct) {
+		
+		x_put_image(app->d, app->buffer, app->gc, app->ximage, 0, 0, 0, 0, app->width, app->height);
+		prof_end(PROF_PUT_IMAGE, start);
+		return;
+	}
+
+	// Calculate how many screen pixels one buffer pixel occupies
+	float scale_x = (float)app->width / app->pixel_buffer_w;
+	float scale_y = (float)app->height / app->pixel_buffer_h;
+
+	//colour of an empty row, the indexed clear colour can be changed through the palette
+	uint32_t fill = app->indexed ? app->palette[PAL_CLEAR] : 0;
+
+	if (fill != app->ximage_fill) {
+		
+		app->ximage_stale = true;
+		app->ximage_fill = fill;
+	}
+
+	//a window exactly 2 or 4 times the buffer width is scaled a row at a time with aligned stores
+	int factor = app->width / app->pixel_buffer_w;
+
+	if (app->width != factor * app->pixel_buffer_w || (factor != 2 && factor != 4) || app->ximage->bytes_per_line % 16 != 0 || (uintptr_t) app->ximage->data % 16 != 0) {
+		
+		factor = 0;
+	}
+
+	//source rows above this one have been read for the last time and are cleared as the scan passes them
+	int clear_from = 0;
+
+	for (int y = 0; y < app->height; y++) {
+
+		// Map current screen row back to the source buffer row
+		int src_y = (int)(y / scale_y);
+		bool used = app->rows_used == NULL || row_used(app->rows_used, src_y);
+
+		//clear them while they are still in cache so the next frame starts on a clean buffer, a smaller window skips some rows entirely
+		clear_rows(app, clear_from, src_y);
+		clear_from = src_y;
+
+		// Get the destination row in the XImage
+		uint32_t *dest_row = (uint32_t *)(app->ximage->data + ((size_t) y * app->ximage->bytes_per_line));
+
+		//nothing was drawn on this row
+		if (!used) {
+			
+			//if it was empty last frame too the ximage row already holds the fill
+			if (!app->ximage_stale && !row_used(app->rows_used_prev, src_y)) {
+				
+				continue;
+			}
+
+			if (fill == 0) {
+				
+				memset(dest_row, 0, app->width * sizeof(uint32_t));
+				continue;
+			}
+
+			for (int x = 0; x < app->width; x++) {
+				
+				dest_row[x] = fill;
+			}
+
+			continue;
+		}
+
+		//a source row stretched over several screen rows is only scaled once, the rest are copies of it
+		if (y > 0 && (int)((y - 1) / scale_y) == src_y) {
+			
+			memcpy(dest_row, (char *) dest_row - app->ximage->bytes_per_line, app->width * sizeof(uint32_t));
+
+		//indexed mode, expand each index through the palette as it is scaled
+		} else if (app->indexed) {
+			
+			uint8_t *src_row = &app->index_buffer[src_y * app->pixel_buffer_w];
+
+			for (int x = 0; x < app->width; x++) {
+
+				dest_row[x] = app->palette[src_row[(int)(x / scale_x)]];
+			}
+
+		} else if (factor != 0) {
+			
+			scale_row(dest_row, &app->pixel_buffer[src_y * app->pixel_buffer_w], app->pixel_buffer_w, factor);
+
+		} else {
+			
+			uint32_t *src_row = &app->pixel_buffer[src_y * app->pixel_buffer_w];
+
+			for (int x = 0; x < app->width; x++) {
+				// Map current screen column back to the source buffer column
+				int src_x = (int)(x / scale_x);
+		
+				// "Sample" the color from the buffer and drop it into the screen
+				dest_row[x] = src_row[src_x];
+			}
+		}
+	}
+
+	clear_rows(app, clear_from, app->pixel_buffer_h);
+
+	app->pixels_cleared = true;
+	app->ximage_stale = false;
+	prof_end(PROF_UPDATE_XIMAGE, start);
+	start = prof_now();
+	
+	// Upload the XImage (CPU RAM) to the Pixmap (X Server/VRAM) This takes whatever is in ximage->data and puts it in the Pixmap 
+	x_put_image(app->d, app->buffer, app->gc, app->ximage, 0, 0, 0, 0, app->width, app->height);	
+	prof_end(PROF_PUT_IMAGE, start);
+}
+
+void draw_pixel_buffer(App *app) {
+	
+	mark_rows(app, 0, app->pixel_buffer_h);
+
+	//fill the pixel_buffer with random data
+	for (int i = 0; app->indexed && i < (app->pixel_buffer_w * app->pixel_buffer_h); i++) {
+	
+		app->index_buffer[i] = (uint8_t)(rand() % app->palette_count);
+	}
+
+	for (int i = 0; !app->indexed && i < (app->pixel_buffer_w * app->pixel_buffer_h); i++) {
 	
 		// rand() gives a big number; we just want a 32-bit color
 		app->pixel_buffer[i] = (uint32_t)rand();
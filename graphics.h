@@ -8,26 +8,52 @@
 #include "vector.h"
 #include "ply.h"
 
-//size of pixel buffer
+//default size of pixel buffer
 #define PBUF_WIDTH 960
 #define PBUF_HEIGHT 540
 
+//largest pixel buffer side, keeps every size and offset into the buffer well inside an int
+#define PBUF_MAX_SIDE 16384
+
+//colour text is drawn in and its fixed palette index in indexed mode
+#define TEXT_COLOUR 0xff00ff00
+#define PAL_CLEAR 0
+#define PAL_TEXT 1
+
+//number of static strings the text run cache can hold
+#define TEXT_RUN_CACHE 32
+
 
 //function Prototypes
 int init_x(App *app, int w, int h);
-void clear_screen(App *app, unsigned long color);
+int resize_x(App *app, int w, int h);
+void clear_screen(App *app);
 void flip_buffer(App *app);
+bool wait_for_event(App *app, double seconds);
 void close_x(App *app);
+uint8_t palette_index(App *app, uint32_t colour);
+void set_palette(App *app, uint8_t index, uint32_t colour);
 void draw_line(App *app, int x1, int y1, int x2, int y2, unsigned long colour);
 void draw_arc(App *app, int x, int y, unsigned int width, unsigned int height, int angle1, int angle2, unsigned long colour);
 void toggle_fullscreen(App *app);
 int load_sprite(Sprite *s, char *filename);
+int sprite_build_spans(Sprite *s);
+void sprite_free(Sprite *s);
 void draw_sprite(App *app, Sprite *s, int start_x, int start_y);
+void draw_sprite_blend(App *app, Sprite *s, int start_x, int start_y);
 void draw_char(App *app, Fontmap *f, int start_x, int start_y, char c);
 void draw_string(App *app, Fontmap *fm, char *str, int x, int y);
+int text_run_reserve(TextRun *run, Fontmap *fm, int chars);
+int text_run_set(TextRun *run, Fontmap *fm, char *str);
+void text_run_free(TextRun *run);
+TextRun *text_run_get(Fontmap *fm, char *str);
+void text_run_cache_free(void);
+void draw_text_run(App *app, TextRun *run, int x, int y);
+void draw_string_cached(App *app, Fontmap *fm, char *str, int x, int y);
 void draw_pixel_buffer(App *app);
 void update_ximage(App *app);
 void load_font(Fontmap *fontmap, char *filename, char *f_map, int char_width, int char_height);
+void font_free(Fontmap *fontmap);
 void load_model3D(Model3D *model);
 
 
@@ -0,0 +1,248 @@
+#ifndef GRID_H
+#define GRID_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "mem.h"
+#include <string.h>
+#include <math.h>
+
+//Uniform grid broadphase over a toroidal (wrapping) playfield centred on 0,0
+//Each cell holds a doubly linked list of entity ids so an entity can move between cells in O(1),
+//this lets the grid be updated incrementally every tick instead of rebuilt from scratch
+typedef struct {
+
+	int cols;		//number of cells across, the playfield width divides into these exactly
+	int rows;		//number of cells down
+	float cell_w;		//width of a cell in world units
+	float cell_h;		//height of a cell in world units
+	float origin_x;		//world position of the left edge of the playfield
+	float origin_y;		//world position of the bottom edge of the playfield
+	int *head;		//first entity in each cell, -1 when the cell is empty
+	int *next;		//next entity in the same cell, -1 at the end of the list
+	int *prev;		//previous entity in the same cell, -1 at the start of the list
+	int *cell;		//cell each entity is linked into, -1 when it is not in the grid
+	int *query;		//scratch buffer of candidate ids filled by grid_query
+	int capacity;		//max number of entity ids
+} Grid;
+
+//wrap a cell coordinate around the playfield
+static inline int grid_wrap(int c, int n) {
+
+	c %= n;
+
+	return (c < 0) ? c + n : c;
+}
+
+static inline int grid_cell_of(Grid *g, float x, float y) {
+
+	int cx = grid_wrap((int) floorf((x - g->origin_x) / g->cell_w), g->cols);
+	int cy = grid_wrap((int) floorf((y - g->origin_y) / g->cell_h), g->rows);
+
+	return cy * g->cols + cx;
+}
+
+//take every entity out of the grid
+static inline void grid_clear(Grid *g) {
+
+	for (int i = 0; i < g->cols * g->rows; i++) {
+
+		g->head[i] = -1;
+	}
+
+	for (int i = 0; i < g->capacity; i++) {
+
+		g->next[i] = -1;
+		g->prev[i] = -1;
+		g->cell[i] = -1;
+	}
+}
+
+//work out the cell layout, cells are at least min_cell wide and the playfield is split into
+//a whole number of them so wrapping stays exact
+static inline void grid_layout(Grid *g, float width, float height, float min_cell) {
+
+	*g = (Grid) {0};
+	g->cols = (int) (width / min_cell);
+	g->rows = (int) (height / min_cell);
+	g->cols = (g->cols < 1) ? 1 : g->cols;
+	g->rows = (g->rows < 1) ? 1 : g->rows;
+	g->cell_w = width / g->cols;
+	g->cell_h = height / g->rows;
+	g->origin_x = -width / 2.0f;
+	g->origin_y = -height / 2.0f;
+}
+
+//bytes of memory a grid with this layout needs for capacity entities
+static inline size_t grid_bytes(Grid *g, int capacity) {
+
+	return ((size_t) g->cols * g->rows + 4 * (size_t) capacity) * sizeof(int);
+}
+
+//set up an empty grid, already laid out by grid_layout, in grid_bytes of memory owned by the caller
+static inline void grid_init_in(Grid *g, int capacity, void *mem) {
+
+	g->capacity = capacity;
+	g->head = mem;
+	g->next = g->head + g->cols * g->rows;
+	g->prev = g->next + capacity;
+	g->cell = g->prev + capacity;
+	g->query = g->cell + capacity;
+
+	grid_clear(g);
+}
+
+static inline int grid_init(Grid *g, float width, float height, float min_cell, int capacity) {
+
+	grid_layout(g, width, height, min_cell);
+
+	void *mem = mem_alloc(MEM_SIM, grid_bytes(g, capacity));
+
+	if (mem == NULL) {
+
+		puts("Could not allocate memory for collision grid");
+		return 1;
+	}
+
+	grid_init_in(g, capacity, mem);
+
+	return 0;
+}
+
+//only for grids made with grid_init
+static inline void grid_free(Grid *g) {
+
+	mem_free(g->head);
+	*g = (Grid) {0};
+}
+
+//move a grid into grid_bytes(g, capacity) of new memory keeping every entity where it is
+static inline void grid_grow_in(Grid *g, int capacity, void *mem) {
+
+	Grid old = *g;
+
+	grid_init_in(g, capacity, mem);
+
+	memcpy(g->head, old.head, g->cols * g->rows * sizeof(int));
+	memcpy(g->next, old.next, old.capacity * sizeof(int));
+	memcpy(g->prev, old.prev, old.capacity * sizeof(int));
+	memcpy(g->cell, old.cell, old.capacity * sizeof(int));
+}
+
+//take an entity out of whatever cell it is in
+static inline void grid_remove(Grid *g, int id) {
+
+	int c = g->cell[id];
+
+	if (c < 0) {
+
+		return;
+	}
+
+	if (g->prev[id] >= 0) {
+
+		g->next[g->prev[id]] = g->next[id];
+
+	} else {
+
+		g->head[c] = g->next[id];
+	}
+
+	if (g->next[id] >= 0) {
+
+		g->prev[g->next[id]] = g->prev[id];
+	}
+
+	g->next[id] = -1;
+	g->prev[id] = -1;
+	g->cell[id] = -1;
+}
+
+//move an entity into cell c, nothing is relinked if it is already there
+static inline void grid_move(Grid *g, int id, int c) {
+
+	if (c == g->cell[id]) {
+
+		return;
+	}
+
+	grid_remove(g, id);
+
+	g->cell[id] = c;
+	g->prev[id] = -1;
+	g->next[id] = g->head[c];
+
+	if (g->head[c] >= 0) {
+
+		g->prev[g->head[c]] = id;
+	}
+
+	g->head[c] = id;
+}
+
+//move an entity to the cell under x,y
+static inline void grid_update(Grid *g, int id, float x, float y) {
+
+	grid_move(g, id, grid_cell_of(g, x, y));
+}
+
+//range of cells overlapped by a query box, the coordinates are unwrapped so wrap them with grid_wrap
+typedef struct {
+
+	int cx0;
+	int cx1;
+	int cy0;
+	int cy1;
+} GridBox;
+
+//cells overlapped by a box of half size radius around x,y
+static inline GridBox grid_box(Grid *g, float x, float y, float radius) {
+
+	GridBox b;
+
+	b.cx0 = (int) floorf((x - radius - g->origin_x) / g->cell_w);
+	b.cx1 = (int) floorf((x + radius - g->origin_x) / g->cell_w);
+	b.cy0 = (int) floorf((y - radius - g->origin_y) / g->cell_h);
+	b.cy1 = (int) floorf((y + radius - g->origin_y) / g->cell_h);
+
+	//a box wider than the playfield would visit cells twice
+	if (b.cx1 - b.cx0 + 1 > g->cols) {
+
+		b.cx0 = 0;
+		b.cx1 = g->cols - 1;
+	}
+
+	if (b.cy1 - b.cy0 + 1 > g->rows) {
+
+		b.cy0 = 0;
+		b.cy1 = g->rows - 1;
+	}
+
+	return b;
+}
+
+//collect every entity in the cells overlapped by a box of half size radius around x,y into g->query
+//the box wraps around the playfield edges, returns the number of candidates found
+//g->query is shared so only one thread may query at a time, walk grid_box cells directly otherwise
+static inline int grid_query(Grid *g, float x, float y, float radius) {
+
+	GridBox b = grid_box(g, x, y, radius);
+	int count = 0;
+
+	for (int cy = b.cy0; cy <= b.cy1; cy++) {
+
+		int row = grid_wrap(cy, g->rows) * g->cols;
+
+		for (int cx = b.cx0; cx <= b.cx1; cx++) {
+
+			for (int id = g->head[row + grid_wrap(cx, g->cols)]; id >= 0; id = g->next[id]) {
+
+				g->query[count++] = id;
+			}
+		}
+	}
+
+	return count;
+}
+
+#endif
@@ -0,0 +1,305 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <sched.h>
+#include <unistd.h>
+#include "jobs.h"
+#include "mem.h"
+
+//queue owned by the current thread, the thread that calls jobs_init owns queue 0
+static _Thread_local int worker_id = 0;
+
+typedef struct {
+
+	JobSystem *js;
+	int id;
+} WorkerStart;
+
+//push onto the bottom of a queue, returns 0 when it is full
+static int queue_push(JobQueue *q, Job job) {
+
+	int pushed = 0;
+
+	pthread_mutex_lock(&q->lock);
+
+	if (q->bottom - q->top < JOBS_QUEUE_SIZE) {
+
+		q->jobs[q->bottom++ & (JOBS_QUEUE_SIZE - 1)] = job;
+		pushed = 1;
+	}
+
+	pthread_mutex_unlock(&q->lock);
+
+	return pushed;
+}
+
+//the owner takes its newest job, it is the one most likely still in cache
+static int queue_pop(JobQueue *q, Job *job) {
+
+	int popped = 0;
+
+	pthread_mutex_lock(&q->lock);
+
+	if (q->bottom != q->top) {
+
+		*job = q->jobs[--q->bottom & (JOBS_QUEUE_SIZE - 1)];
+		popped = 1;
+	}
+
+	pthread_mutex_unlock(&q->lock);
+
+	return popped;
+}
+
+//other threads take the oldest job, which tends to be the largest remaining piece of work
+static int queue_steal(JobQueue *q, Job *job) {
+
+	int stolen = 0;
+
+	pthread_mutex_lock(&q->lock);
+
+	if (q->bottom != q->top) {
+
+		*job = q->jobs[q->top++ & (JOBS_QUEUE_SIZE - 1)];
+		stolen = 1;
+	}
+
+	pthread_mutex_unlock(&q->lock);
+
+	return stolen;
+}
+
+static void run_job(Job *job) {
+
+	job->fn(job->data, job->begin, job->end);
+	atomic_fetch_sub_explicit(&job->counter->pending, 1, memory_order_release);
+}
+
+//run one job from this threads queue or stolen from another, returns 0 when there was nothing to do
+static int run_one(JobSystem *js) {
+
+	Job job;
+	int id = worker_id;
+
+	if (atomic_load_explicit(&js->queued, memory_order_relaxed) == 0) {
+
+		return 0;
+	}
+
+	if (!queue_pop(&js->queues[id], &job)) {
+
+		int found = 0;
+
+		for (int k = 1; k < js->thread_count && !found; k++) {
+
+			found = queue_steal(&js->queues[(id + k) % js->thread_count], &job);
+		}
+
+		if (!found) {
+
+			return 0;
+		}
+	}
+
+	atomic_fetch_sub_explicit(&js->queued, 1, memory_order_relaxed);
+	run_job(&job);
+
+	return 1;
+}
+
+static void *worker_main(void *arg) {
+
+	WorkerStart *start = arg;
+	JobSystem *js = start->js;
+
+	worker_id = start->id;
+	mem_free(start);
+
+	while (!atomic_load(&js->quit)) {
+
+		if (run_one(js)) {
+
+			continue;
+		}
+
+		//nothing to run or steal, sleep until a job is queued
+		pthread_mutex_lock(&js->sleep_lock);
+
+		while (atomic_load(&js->queued) == 0 && !atomic_load(&js->quit)) {
+
+			pthread_cond_wait(&js->wake, &js->sleep_lock);
+		}
+
+		pthread_mutex_unlock(&js->sleep_lock);
+	}
+
+	return NULL;
+}
+
+int jobs_default_threads(void) {
+
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return (n < 1) ? 1 : (n > JOBS_MAX_THREADS) ? JOBS_MAX_THREADS : (int) n;
+}
+
+//start thread_count - 1 workers, the calling thread makes up the last one whenever it waits on a batch
+int jobs_init(JobSystem *js, int thread_count) {
+
+	thread_count = (thread_count < 1) ? 1 : (thread_count > JOBS_MAX_THREADS) ? JOBS_MAX_THREADS : thread_count;
+
+	js->thread_count = 1;
+	js->queues = mem_calloc(MEM_OTHER, thread_count, sizeof(JobQueue));
+
+	if (js->queues == NULL) {
+
+		puts("Could not allocate memory for job queues");
+		return 1;
+	}
+
+	for (int i = 0; i < thread_count; i++) {
+
+		pthread_mutex_init(&js->queues[i].lock, NULL);
+	}
+
+	pthread_mutex_init(&js->sleep_lock, NULL);
+	pthread_cond_init(&js->wake, NULL);
+	atomic_init(&js->queued, 0);
+	atomic_init(&js->quit, false);
+	worker_id = 0;
+
+	for (int i = 1; i < thread_count; i++) {
+
+		WorkerStart *start = mem_alloc(MEM_OTHER, sizeof(WorkerStart));
+
+		if (start == NULL) {
+
+			puts("Could not start job thread, carrying on with fewer");
+			break;
+		}
+
+		*start = (WorkerStart) {js, i};
+
+		if (pthread_create(&js->threads[i], NULL, worker_main, start) != 0) {
+
+			puts("Could not start job thread, carrying on with fewer");
+			mem_free(start);
+			break;
+		}
+
+		js->thread_count++;
+	}
+
+	return 0;
+}
+
+void jobs_shutdown(JobSystem *js) {
+
+	pthread_mutex_lock(&js->sleep_lock);
+	atomic_store(&js->quit, true);
+	pthread_cond_broadcast(&js->wake);
+	pthread_mutex_unlock(&js->sleep_lock);
+
+	for (int i = 1; i < js->thread_count; i++) {
+
+		pthread_join(js->threads[i], NULL);
+	}
+
+	for (int i = 0; i < js->thread_count; i++) {
+
+		pthread_mutex_destroy(&js->queues[i].lock);
+	}
+
+	pthread_mutex_destroy(&js->sleep_lock);
+	pthread_cond_destroy(&js->wake);
+	mem_free(js->queues);
+	js->queues = NULL;
+	js->thread_count = 0;
+}
+
+//queue one job without waking anyone, returns 0 if the job had to be run on the spot
+static int push_job(JobSystem *js, Job job) {
+
+	atomic_fetch_add_explicit(&job.counter->pending, 1, memory_order_relaxed);
+
+	//with no workers there is nobody to hand the job to
+	if (js->thread_count > 1) {
+
+		atomic_fetch_add_explicit(&js->queued, 1, memory_order_relaxed);
+
+		if (queue_push(&js->queues[worker_id], job)) {
+
+			return 1;
+		}
+
+		atomic_fetch_sub_explicit(&js->queued, 1, memory_order_relaxed);
+	}
+
+	run_job(&job);
+
+	return 0;
+}
+
+static void wake_workers(JobSystem *js, int all) {
+
+	pthread_mutex_lock(&js->sleep_lock);
+
+	if (all) {
+
+		pthread_cond_broadcast(&js->wake);
+
+	} else {
+
+		pthread_cond_signal(&js->wake);
+	}
+
+	pthread_mutex_unlock(&js->sleep_lock);
+}
+
+void jobs_submit(JobSystem *js, JobFn fn, void *data, int begin, int end, JobCounter *counter) {
+
+	if (push_job(js, (Job) {fn, data, begin, end, counter})) {
+
+		wake_workers(js, 0);
+	}
+}
+
+//split [0, count) into jobs of grain items, a batch that fits in one job runs on the calling thread straight away
+void jobs_parallel_for(JobSystem *js, JobFn fn, void *data, int count, int grain, JobCounter *counter) {
+
+	if (count <= 0) {
+
+		return;
+	}
+
+	if (count <= grain || js->thread_count == 1) {
+
+		fn(data, 0, count);
+		return;
+	}
+
+	int queued = 0;
+
+	for (int begin = 0; begin < count; begin += grain) {
+
+		int end = (begin + grain < count) ? begin + grain : count;
+
+		queued |= push_job(js, (Job) {fn, data, begin, end, counter});
+	}
+
+	if (queued) {
+
+		wake_workers(js, 1);
+	}
+}
+
+//help run jobs until every job counted by counter has finished
+void jobs_wait(JobSystem *js, JobCounter *counter) {
+
+	while (atomic_load_explicit(&counter->pending, memory_order_acquire) > 0) {
+
+		if (!run_one(js)) {
+
+			sched_yield();
+		}
+	}
+}
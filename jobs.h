@@ -0,0 +1,59 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+//most threads the job system will run, including the thread that calls jobs_wait
+#define JOBS_MAX_THREADS 64
+
+//slots in each threads job queue, a power of 2, jobs pushed onto a full queue run straight away instead
+#define JOBS_QUEUE_SIZE 1024
+
+//a job works on the range [begin, end) of whatever data points to
+typedef void (*JobFn)(void *data, int begin, int end);
+
+//counts the unfinished jobs of a batch, jobs_wait on it is how one batch is made to depend on another
+typedef struct {
+
+	atomic_int pending;
+} JobCounter;
+
+typedef struct {
+
+	JobFn fn;
+	void *data;
+	int begin;
+	int end;
+	JobCounter *counter;	//decremented once the job has run
+} Job;
+
+//Each thread owns a queue, it pushes and pops at the bottom and idle threads steal from the top
+typedef struct {
+
+	pthread_mutex_t lock;
+	Job jobs[JOBS_QUEUE_SIZE];
+	unsigned int top;	//oldest job, where other threads steal from
+	unsigned int bottom;	//one past the newest job, where the owner pushes and pops
+} JobQueue;
+
+typedef struct {
+
+	int thread_count;		//worker threads plus the calling thread
+	pthread_t threads[JOBS_MAX_THREADS];
+	JobQueue *queues;		//one per thread, queue 0 belongs to the thread that called jobs_init
+	pthread_mutex_t sleep_lock;	//idle workers sleep on wake until a job is queued
+	pthread_cond_t wake;
+	atomic_int queued;		//jobs sitting in queues across every thread
+	atomic_bool quit;
+} JobSystem;
+
+//function Prototypes
+int jobs_init(JobSystem *js, int thread_count);
+void jobs_shutdown(JobSystem *js);
+int jobs_default_threads(void);
+void jobs_submit(JobSystem *js, JobFn fn, void *data, int begin, int end, JobCounter *counter);
+void jobs_parallel_for(JobSystem *js, JobFn fn, void *data, int count, int grain, JobCounter *counter);
+void jobs_wait(JobSystem *js, JobCounter *counter);
+
+#endif
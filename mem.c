@@ -0,0 +1,271 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include "mem.h"
+
+//size of a transparent or explicit huge page on x86-64, mappings are rounded up to it
+#define MEM_HUGE_PAGE ((size_t) 2 << 20)
+
+//header flags, a mapped block is given back with munmap instead of free
+#define MEM_MAPPED 1
+
+static const char *tag_names[MEM_TAG_COUNT] = {
+
+	"meshes", "sprites", "framebuffers", "X", "simulation", "arenas", "other"
+};
+
+//sits just before every pointer handed out, offset leads back to what malloc returned
+typedef struct {
+
+	uint64_t size;
+	uint16_t tag;
+	uint16_t flags;
+	uint32_t offset;
+} MemHeader;
+
+//counted with atomics, worker threads free what the main thread allocated for them
+static struct {
+
+	_Atomic uint64_t allocs[MEM_TAG_COUNT];
+	_Atomic uint64_t frees[MEM_TAG_COUNT];
+	_Atomic uint64_t live_bytes[MEM_TAG_COUNT];
+	_Atomic uint64_t peak_bytes[MEM_TAG_COUNT];
+	_Atomic uint64_t total_allocs;
+	atomic_bool guard;
+} mem;
+
+static void check_guard(MemTag tag, size_t size) {
+
+	if (atomic_load_explicit(&mem.guard, memory_order_relaxed)) {
+
+		fflush(stdout);
+		fprintf(stderr, "allocation of %zu bytes for %s inside the frame loop\n", size, tag_names[tag]);
+		abort();
+	}
+}
+
+static void track_alloc(MemTag tag, size_t size) {
+
+	check_guard(tag, size);
+
+	uint64_t live = atomic_fetch_add_explicit(&mem.live_bytes[tag], size, memory_order_relaxed) + size;
+
+	atomic_fetch_add_explicit(&mem.allocs[tag], 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&mem.total_allocs, 1, memory_order_relaxed);
+
+	if (live > atomic_load_explicit(&mem.peak_bytes[tag], memory_order_relaxed)) {
+
+		atomic_store_explicit(&mem.peak_bytes[tag], live, memory_order_relaxed);
+	}
+}
+
+static void track_free(MemTag tag, size_t size) {
+
+	atomic_fetch_sub_explicit(&mem.live_bytes[tag], size, memory_order_relaxed);
+	atomic_fetch_add_explicit(&mem.frees[tag], 1, memory_order_relaxed);
+}
+
+//place the header before user and count the allocation
+static void *finish_alloc(MemTag tag, unsigned char *raw, unsigned char *user, size_t size) {
+
+	MemHeader *h = (MemHeader *) user - 1;
+
+	h->size = size;
+	h->tag = tag;
+	h->flags = 0;
+	h->offset = (uint32_t) (user - raw);
+	track_alloc(tag, size);
+
+	return user;
+}
+
+void *mem_alloc(MemTag tag, size_t size) {
+
+	unsigned char *raw = malloc(sizeof(MemHeader) + size);
+
+	if (raw == NULL) {
+
+		return NULL;
+	}
+
+	return finish_alloc(tag, raw, raw + sizeof(MemHeader), size);
+}
+
+void *mem_calloc(MemTag tag, size_t count, size_t size) {
+
+	if (size != 0 && count > (SIZE_MAX - sizeof(MemHeader)) / size) {
+
+		return NULL;
+	}
+
+	unsigned char *raw = calloc(1, sizeof(MemHeader) + count * size);
+
+	if (raw == NULL) {
+
+		return NULL;
+	}
+
+	return finish_alloc(tag, raw, raw + sizeof(MemHeader), count * size);
+}
+
+//align must be a power of 2, the padding in front of the pointer holds the header
+void *mem_aligned_alloc(MemTag tag, size_t align, size_t size) {
+
+	align = (align < sizeof(MemHeader)) ? sizeof(MemHeader) : align;
+
+	unsigned char *raw = malloc(sizeof(MemHeader) + align - 1 + size);
+
+	if (raw == NULL) {
+
+		return NULL;
+	}
+
+	uintptr_t user = ((uintptr_t) raw + sizeof(MemHeader) + align - 1) & ~(uintptr_t) (align - 1);
+
+	return finish_alloc(tag, raw, (unsigned char *) user, size);
+}
+
+//Framebuffers are read and written end to end every frame, on 4 KB pages a 4K XImage touches thousands of
+//TLB entries per pass. Try explicit huge pages, then a 2 MB aligned mapping with transparent huge pages
+//asked for, then plain aligned memory. The pointer is always MEM_FRAMEBUFFER_ALIGN aligned
+void *mem_huge_alloc(MemTag tag, size_t size) {
+
+	size_t len = (size + MEM_FRAMEBUFFER_ALIGN + MEM_HUGE_PAGE - 1) & ~(MEM_HUGE_PAGE - 1);
+	unsigned char *base = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+	base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+
+	//map an extra huge page so the start can be moved up to a huge page boundary, then trim both ends
+	if (base == MAP_FAILED) {
+
+		unsigned char *over = mmap(NULL, len + MEM_HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+		if (over != MAP_FAILED) {
+
+			base = (unsigned char *) (((uintptr_t) over + MEM_HUGE_PAGE - 1) & ~(uintptr_t) (MEM_HUGE_PAGE - 1));
+
+			if (base > over) {
+
+				munmap(over, base - over);
+			}
+
+			munmap(base + len, (over + len + MEM_HUGE_PAGE) - (base + len));
+
+#ifdef MADV_HUGEPAGE
+			madvise(base, len, MADV_HUGEPAGE);
+#endif
+		}
+	}
+
+	if (base == MAP_FAILED) {
+
+		return mem_aligned_alloc(tag, MEM_FRAMEBUFFER_ALIGN, size);
+	}
+
+	void *user = finish_alloc(tag, base, base + MEM_FRAMEBUFFER_ALIGN, size);
+
+	((MemHeader *) user - 1)->flags = MEM_MAPPED;
+
+	return user;
+}
+
+//a block keeps the tag it was first allocated with, an aligned block is moved rather than resized in place
+void *mem_realloc(MemTag tag, void *p, size_t size) {
+
+	if (p == NULL) {
+
+		return mem_alloc(tag, size);
+	}
+
+	MemHeader *h = (MemHeader *) p - 1;
+	MemTag old_tag = h->tag;
+	size_t old_size = h->size;
+
+	if (h->offset != sizeof(MemHeader)) {
+
+		void *moved = mem_alloc(old_tag, size);
+
+		if (moved != NULL) {
+
+			memcpy(moved, p, (old_size < size) ? old_size : size);
+			mem_free(p);
+		}
+
+		return moved;
+	}
+
+	check_guard(old_tag, size);
+
+	unsigned char *raw = realloc(h, sizeof(MemHeader) + size);
+
+	if (raw == NULL) {
+
+		return NULL;
+	}
+
+	track_free(old_tag, old_size);
+
+	return finish_alloc(old_tag, raw, raw + sizeof(MemHeader), size);
+}
+
+void mem_free(void *p) {
+
+	if (p == NULL) {
+
+		return;
+	}
+
+	MemHeader *h = (MemHeader *) p - 1;
+
+	track_free(h->tag, h->size);
+
+	if (h->flags & MEM_MAPPED) {
+
+		munmap((unsigned char *) p - h->offset, (h->size + h->offset + MEM_HUGE_PAGE - 1) & ~(MEM_HUGE_PAGE - 1));
+		return;
+	}
+
+	free((unsigned char *) p - h->offset);
+}
+
+void mem_get_stats(MemTag tag, MemStats *stats) {
+
+	stats->allocs = atomic_load_explicit(&mem.allocs[tag], memory_order_relaxed);
+	stats->frees = atomic_load_explicit(&mem.frees[tag], memory_order_relaxed);
+	stats->live_bytes = atomic_load_explicit(&mem.live_bytes[tag], memory_order_relaxed);
+	stats->peak_bytes = atomic_load_explicit(&mem.peak_bytes[tag], memory_order_relaxed);
+}
+
+//allocations of every subsystem since the start, the difference across a frame is what that frame allocated
+uint64_t mem_alloc_count(void) {
+
+	return atomic_load_explicit(&mem.total_allocs, memory_order_relaxed);
+}
+
+const char *mem_tag_name(MemTag tag) {
+
+	return tag_names[tag];
+}
+
+//while on any allocation aborts the program, for catching allocations in code that should not make any
+void mem_guard(bool on) {
+
+	atomic_store(&mem.guard, on);
+}
+
+void mem_print_summary(void) {
+
+	printf("%-14s %10s %10s %12s %12s\n", "memory", "allocs", "frees", "live KB", "peak KB");
+
+	for (int t = 0; t < MEM_TAG_COUNT; t++) {
+
+		MemStats s;
+
+		mem_get_stats(t, &s);
+		printf("%-14s %10llu %10llu %12.1f %12.1f\n", tag_names[t], (unsigned long long) s.allocs, (unsigned long long) s.frees, s.live_bytes / 1024.0, s.peak_bytes / 1024.0);
+	}
+}
@@ -0,0 +1,48 @@
+#ifndef MEM_H
+#define MEM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+//alignment of framebuffers from mem_huge_alloc, a cache line and wide enough for any SIMD load or store
+#define MEM_FRAMEBUFFER_ALIGN 64
+
+//what an allocation is for, counts and live bytes are kept for each
+typedef enum {
+
+	MEM_MESH,		//ply vertex and face arrays
+	MEM_SPRITE,		//sprites, fonts, text runs and image decoding
+	MEM_FRAMEBUFFER,	//pixel and index buffers and their row bitmaps
+	MEM_X,			//memory handed to Xlib, the XImage data
+	MEM_SIM,		//entity pools, grids and bullets
+	MEM_ARENA,		//arena blocks, whatever is allocated inside them is not counted again
+	MEM_OTHER,		//job queues, trace buffers and benchmark samples
+	MEM_TAG_COUNT
+} MemTag;
+
+typedef struct {
+
+	uint64_t allocs;
+	uint64_t frees;
+	uint64_t live_bytes;
+	uint64_t peak_bytes;
+} MemStats;
+
+//Every allocation in the program goes through these so it is counted against its subsystem. Memory from
+//them must be given back with mem_free, and memory from anywhere else must never be passed to mem_free
+void *mem_alloc(MemTag tag, size_t size);
+void *mem_calloc(MemTag tag, size_t count, size_t size);
+void *mem_realloc(MemTag tag, void *p, size_t size);
+void *mem_aligned_alloc(MemTag tag, size_t align, size_t size);
+void *mem_huge_alloc(MemTag tag, size_t size);
+void mem_free(void *p);
+
+//function Prototypes
+void mem_get_stats(MemTag tag, MemStats *stats);
+uint64_t mem_alloc_count(void);
+const char *mem_tag_name(MemTag tag);
+void mem_guard(bool on);
+void mem_print_summary(void);
+
+#endif
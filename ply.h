@@ -6,6 +6,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "types.h"
+#include "mem.h"
 
 //the max size in bytes this parser can read from a .ply file
 #define MAX_LINE 256
@@ -33,14 +34,11 @@ static inline void load_ply(Model3D *model, char filename[]) {
 		if (strstr(buffer, "element vertex")) {
 			
 			sscanf(buffer, "%*s %*s %d", &model->local_count);
-			model->local_verts = malloc(model->local_count * sizeof(Vector3));
-			model->screen_verts = malloc(model->local_count * sizeof(Vector3));
+			model->local_verts = mem_alloc(MEM_MESH, model->local_count * sizeof(Vector3));
 			
-			if (model->local_verts == NULL || model->screen_verts == NULL) {
+			if (model->local_verts == NULL) {
 				
 				puts("Could not allocate memory for vert data");
-				free(model->local_verts);
-				free(model->screen_verts);
 				return;
 			}
 		}
@@ -49,7 +47,7 @@ static inline void load_ply(Model3D *model, char filename[]) {
 		if (strstr(buffer, "element face")) {
 			
 			sscanf(buffer, "%*s %*s %d", &model->facev_count);
-			model->facev = malloc(model->facev_count * sizeof(int));	
+			model->facev = mem_alloc(MEM_MESH, model->facev_count * sizeof(int));	
 			
 			if (model->facev == NULL) {
 				
@@ -99,7 +97,7 @@ static inline void load_ply(Model3D *model, char filename[]) {
 	int index = 0;				
 	
 	//Allocate memory on the heap for the large array containing all the indices into the local_verts array for every face in the mesh
-	model->meshf = malloc(model->meshf_count * sizeof(int));
+	model->meshf = mem_alloc(MEM_MESH, model->meshf_count * sizeof(int));
 	
 	if (model->meshf == NULL) {
 		
@@ -143,10 +141,9 @@ static inline void model3D_free(Model3D *model) {
 	}
 
 	//free the malloc'd vertex, facev and meshf array
-	free(model->screen_verts);
-	free(model->local_verts);
-	free(model->facev);
-	free(model->meshf);
+	mem_free(model->local_verts);
+	mem_free(model->facev);
+	mem_free(model->meshf);
 }
 
 #endif
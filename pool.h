@@ -0,0 +1,145 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "mem.h"
+#include <string.h>
+
+//Slot allocator for a fixed capacity array of entities. Free slots are kept on a stack and live slots
+//in a dense array, so spawning, despawning and counting live entities are all O(1) and loops over
+//live entities never touch dead ones
+typedef struct {
+
+	int *free_ids;		//stack of unused slots, the lowest slot is on top
+	int free_count;		//number of slots on the free stack
+	int *live;		//dense array of the slots in use, in no particular order
+	int *live_pos;		//index of each slot in the live array, -1 when the slot is free
+	int live_count;		//number of slots in use
+	int capacity;		//total number of slots
+} Pool;
+
+//free every slot
+static inline void pool_reset(Pool *p) {
+
+	p->free_count = p->capacity;
+	p->live_count = 0;
+
+	for (int i = 0; i < p->capacity; i++) {
+
+		//push in reverse so slot 0 is handed out first
+		p->free_ids[i] = p->capacity - 1 - i;
+		p->live_pos[i] = -1;
+	}
+}
+
+//bytes of memory a pool of this capacity needs
+static inline size_t pool_bytes(int capacity) {
+
+	return 3 * (size_t) capacity * sizeof(int);
+}
+
+//set up an empty pool in pool_bytes(capacity) of memory owned by the caller
+static inline void pool_init_in(Pool *p, int capacity, void *mem) {
+
+	*p = (Pool) {0};
+	p->capacity = capacity;
+	p->free_ids = mem;
+	p->live = p->free_ids + capacity;
+	p->live_pos = p->live + capacity;
+
+	pool_reset(p);
+}
+
+static inline int pool_init(Pool *p, int capacity) {
+
+	void *mem = mem_alloc(MEM_SIM, pool_bytes(capacity));
+
+	if (mem == NULL) {
+
+		puts("Could not allocate memory for entity pool");
+		return 1;
+	}
+
+	pool_init_in(p, capacity, mem);
+
+	return 0;
+}
+
+//only for pools made with pool_init
+static inline void pool_free(Pool *p) {
+
+	mem_free(p->free_ids);
+	*p = (Pool) {0};
+}
+
+//move a pool into pool_bytes(capacity) of new memory, live slots keep their ids and the extra slots are added as free
+static inline void pool_grow_in(Pool *p, int capacity, void *mem) {
+
+	Pool old = *p;
+
+	p->capacity = capacity;
+	p->free_ids = mem;
+	p->live = p->free_ids + capacity;
+	p->live_pos = p->live + capacity;
+
+	memcpy(p->live, old.live, old.live_count * sizeof(int));
+	memcpy(p->live_pos, old.live_pos, old.capacity * sizeof(int));
+
+	for (int i = old.capacity; i < capacity; i++) {
+
+		p->live_pos[i] = -1;
+	}
+
+	//new slots go under the old free ones so the lowest free slot is still handed out first
+	p->free_count = 0;
+
+	for (int i = capacity - 1; i >= old.capacity; i--) {
+
+		p->free_ids[p->free_count++] = i;
+	}
+
+	memcpy(&p->free_ids[p->free_count], old.free_ids, old.free_count * sizeof(int));
+	p->free_count += old.free_count;
+}
+
+//take a free slot and mark it live, returns -1 when the pool is full
+static inline int pool_alloc(Pool *p) {
+
+	if (p->free_count == 0) {
+
+		return -1;
+	}
+
+	int id = p->free_ids[--p->free_count];
+
+	p->live_pos[id] = p->live_count;
+	p->live[p->live_count++] = id;
+
+	return id;
+}
+
+//return a live slot to the free stack, the last live slot is swapped into its place in the live array
+static inline void pool_release(Pool *p, int id) {
+
+	int pos = p->live_pos[id];
+
+	if (pos < 0) {
+
+		return;
+	}
+
+	int last = p->live[--p->live_count];
+
+	p->live[pos] = last;
+	p->live_pos[last] = pos;
+	p->live_pos[id] = -1;
+	p->free_ids[p->free_count++] = id;
+}
+
+static inline int pool_is_live(Pool *p, int id) {
+
+	return p->live_pos[id] >= 0;
+}
+
+#endif
@@ -0,0 +1,294 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "graphics.h"
+#include "profile.h"
+#include "trace.h"
+#include "mem.h"
+
+//longest bar in the overlay, a bar this long is a whole 60 fps frame
+#define PROF_BAR_CHARS 40
+#define PROF_BAR_FULL (1.0 / 60.0)
+
+//fps, the stage header, a line per stage, the memory header and a line per subsystem
+#define PROF_OVERLAY_LINES (2 + PROF_FRAME + 1 + MEM_TAG_COUNT)
+
+static const char *stage_names[PROF_STAGE_COUNT] = {
+
+	"events", "simulate", "project", "draw_mesh", "text", "clear_screen", "update_ximage", "XPutImage", "flip_buffer", "XSync", "frame"
+};
+
+//Everything is kept in one static block, stages are timed from all over the program and there is only one main loop
+static struct {
+
+	double current[PROF_STAGE_COUNT];		//time spent in each stage so far this frame
+	float window[PROF_STAGE_COUNT][PROF_WINDOW];	//seconds per stage over the last PROF_WINDOW frames
+	uint32_t histogram[PROF_STAGE_COUNT][PROF_BUCKETS];	//every frame since the start, for the exit summary
+	double total[PROF_STAGE_COUNT];
+	double max[PROF_STAGE_COUNT];
+	double frame_start;				//0 before the first frame
+	uint64_t alloc_mark;				//allocation count when this frame started
+	uint64_t frame_allocs;				//allocations made by the last finished frame
+	uint64_t max_frame_allocs;
+	int frames;					//frames finished
+	int skipped;					//frames that drew nothing, they are left out of every statistic
+	bool overlay;
+	TextRun lines[PROF_OVERLAY_LINES];		//held run of every overlay line, only the glyphs that change are redrawn
+} prof;
+
+double prof_now(void) {
+
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+//add the time since start to a stage, a stage entered many times in a frame adds up
+//while tracing every stage is also recorded as a span on the timeline
+void prof_end(ProfStage stage, double start) {
+
+	double end = prof_now();
+
+	prof.current[stage] += end - start;
+
+	if (trace_enabled) {
+
+		trace_event(stage_names[stage], (uint64_t) (start * 1e9), (uint64_t) (end * 1e9));
+	}
+}
+
+//histogram bucket of a time, buckets are PROF_SUB_BUCKETS per doubling from 1 us
+static int bucket_of(double seconds) {
+
+	double us = seconds * 1e6;
+
+	if (us < 1.0) {
+
+		return 0;
+	}
+
+	int octave;
+	double mantissa = frexp(us, &octave);		//us = mantissa * 2^octave, mantissa in [0.5, 1)
+	int bucket = 1 + (octave - 1) * PROF_SUB_BUCKETS + (int) ((mantissa * 2.0 - 1.0) * PROF_SUB_BUCKETS);
+
+	return (bucket < PROF_BUCKETS) ? bucket : PROF_BUCKETS - 1;
+}
+
+//middle of a bucket in seconds, anything under 1 us counts as nothing
+static double bucket_value(int bucket) {
+
+	if (bucket == 0) {
+
+		return 0.0;
+	}
+
+	int octave = (bucket - 1) / PROF_SUB_BUCKETS;
+	int sub = (bucket - 1) % PROF_SUB_BUCKETS;
+
+	return ldexp(1.0 + (sub + 0.5) / PROF_SUB_BUCKETS, octave) * 1e-6;
+}
+
+//close the last frame and start timing a new one, call once at the top of the main loop
+void prof_frame_begin(void) {
+
+	double now = prof_now();
+
+	if (prof.frame_start > 0.0) {
+
+		prof.current[PROF_FRAME] = now - prof.frame_start;
+
+		for (int s = 0; s < PROF_STAGE_COUNT; s++) {
+
+			double t = prof.current[s];
+
+			prof.window[s][prof.frames % PROF_WINDOW] = (float) t;
+			prof.histogram[s][bucket_of(t)]++;
+			prof.total[s] += t;
+			prof.max[s] = (t > prof.max[s]) ? t : prof.max[s];
+		}
+
+		prof.frame_allocs = mem_alloc_count() - prof.alloc_mark;
+		prof.max_frame_allocs = (prof.frame_allocs > prof.max_frame_allocs) ? prof.frame_allocs : prof.max_frame_allocs;
+		prof.frames++;
+	}
+
+	memset(prof.current, 0, sizeof(prof.current));
+	prof.alloc_mark = mem_alloc_count();
+	prof.frame_start = now;
+}
+
+//drop the frame begun last, it drew nothing and its time is mostly spent waiting for input
+void prof_frame_skip(void) {
+
+	prof.frame_start = 0.0;
+	prof.skipped++;
+}
+
+void prof_toggle_overlay(void) {
+
+	prof.overlay = !prof.overlay;
+}
+
+//the overlay changes every frame, a screen showing it is never static
+bool prof_overlay_visible(void) {
+
+	return prof.overlay;
+}
+
+//size the run of every overlay line up front, a game under --alloc-check can then show the overlay
+//returns 1 if a run could not be allocated
+int prof_reserve_overlay(Fontmap *fm) {
+
+	for (int i = 0; i < PROF_OVERLAY_LINES; i++) {
+
+		if (text_run_reserve(&prof.lines[i], fm, TEXT_RUN_MAX - 1) != 0) {
+
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+void prof_free_overlay(void) {
+
+	for (int i = 0; i < PROF_OVERLAY_LINES; i++) {
+
+		text_run_free(&prof.lines[i]);
+	}
+}
+
+//draw a line of the overlay through its run, returns the y of the next line
+static int overlay_line(App *app, Fontmap *fm, int line, char *text, int x, int y) {
+
+	if (text_run_set(&prof.lines[line], fm, text) == 0) {
+
+		draw_text_run(app, &prof.lines[line], x, y);
+
+	} else {
+
+		draw_string(app, fm, text, x, y);
+	}
+
+	return y + fm->char_height;
+}
+
+static int compare_float(const void *a, const void *b) {
+
+	float x = *(const float *) a;
+	float y = *(const float *) b;
+
+	return (x > y) - (x < y);
+}
+
+//draw min/avg/p99 of every stage over the last PROF_WINDOW frames with a bar for the average, plus fps and the worst frame
+//returns the y of the line below the overlay, or 0 when it is hidden
+int prof_draw_overlay(App *app, Fontmap *fm, int x, int y) {
+
+	int n = (prof.frames < PROF_WINDOW) ? prof.frames : PROF_WINDOW;
+	char line[128];
+	int l = 0;
+
+	if (!prof.overlay || n == 0) {
+
+		return 0;
+	}
+
+	float sorted[PROF_WINDOW];
+	double frame_sum = 0.0;
+	float worst = 0.0f;
+
+	for (int i = 0; i < n; i++) {
+
+		frame_sum += prof.window[PROF_FRAME][i];
+		worst = (prof.window[PROF_FRAME][i] > worst) ? prof.window[PROF_FRAME][i] : worst;
+	}
+
+	snprintf(line, sizeof(line), "FPS %.1f  worst frame %.2f ms  %d rendered %d skipped", n / frame_sum, worst * 1000.0f, prof.frames, prof.skipped);
+	y = overlay_line(app, fm, l++, line, x, y);
+
+	snprintf(line, sizeof(line), "%-14s %6s %6s %6s ms", "stage", "min", "avg", "p99");
+	y = overlay_line(app, fm, l++, line, x, y);
+
+	for (int s = 0; s < PROF_FRAME; s++) {
+
+		double sum = 0.0;
+
+		memcpy(sorted, prof.window[s], n * sizeof(float));
+		qsort(sorted, n, sizeof(float), compare_float);
+
+		for (int i = 0; i < n; i++) {
+
+			sum += sorted[i];
+		}
+
+		double avg = sum / n;
+		int bar = (int) (avg / PROF_BAR_FULL * PROF_BAR_CHARS + 0.5);
+		int len;
+
+		bar = (bar > PROF_BAR_CHARS) ? PROF_BAR_CHARS : bar;
+		len = snprintf(line, sizeof(line), "%-14s %6.2f %6.2f %6.2f    ", stage_names[s], sorted[0] * 1000.0, avg * 1000.0, sorted[(int) (0.99 * (n - 1))] * 1000.0);
+		memset(&line[len], '#', bar);
+		line[len + bar] = '\0';
+
+		y = overlay_line(app, fm, l++, line, x, y);
+	}
+
+	//memory of every subsystem, anything allocated in the last frame is worth a look
+	snprintf(line, sizeof(line), "%-14s %6s %6s %9s KB   %llu allocs last frame", "memory", "allocs", "frees", "live", (unsigned long long) prof.frame_allocs);
+	y = overlay_line(app, fm, l++, line, x, y);
+
+	for (int t = 0; t < MEM_TAG_COUNT; t++) {
+
+		MemStats s;
+
+		mem_get_stats(t, &s);
+		snprintf(line, sizeof(line), "%-14s %6llu %6llu %9.1f", mem_tag_name(t), (unsigned long long) s.allocs, (unsigned long long) s.frees, s.live_bytes / 1024.0);
+		y = overlay_line(app, fm, l++, line, x, y);
+	}
+
+	return y;
+}
+
+//value below which fraction p of the recorded frames fall, never more than the largest time seen
+static double histogram_percentile(uint32_t *histogram, int frames, double p, double max) {
+
+	uint32_t target = (uint32_t) ceil(p * frames);
+	uint32_t seen = 0;
+	int b = 0;
+
+	for (; b < PROF_BUCKETS - 1; b++) {
+
+		seen += histogram[b];
+
+		if (seen >= target && seen > 0) {
+
+			break;
+		}
+	}
+
+	return (bucket_value(b) < max) ? bucket_value(b) : max;
+}
+
+//percentiles of every stage over the whole run, taken from log buckets so they are within about 6 percent
+void prof_print_summary(void) {
+
+	if (prof.frames == 0) {
+
+		return;
+	}
+
+	printf("frame profile over %d frames, %.1f fps average, %d idle frames skipped\n", prof.frames, prof.frames / prof.total[PROF_FRAME], prof.skipped);
+	printf("%-14s %9s %9s %9s %9s %9s\n", "stage (ms)", "mean", "p50", "p90", "p99", "max");
+
+	for (int s = 0; s < PROF_STAGE_COUNT; s++) {
+
+		printf("%-14s %9.3f %9.3f %9.3f %9.3f %9.3f\n", stage_names[s], prof.total[s] / prof.frames * 1000.0, histogram_percentile(prof.histogram[s], prof.frames, 0.50, prof.max[s]) * 1000.0, histogram_percentile(prof.histogram[s], prof.frames, 0.90, prof.max[s]) * 1000.0, histogram_percentile(prof.histogram[s], prof.frames, 0.99, prof.max[s]) * 1000.0, prof.max[s] * 1000.0);
+	}
+
+	printf("at most %llu allocations in one frame\n", (unsigned long long) prof.max_frame_allocs);
+}
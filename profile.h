@@ -0,0 +1,57 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "types.h"
+
+//frames the overlay statistics are taken over
+#define PROF_WINDOW 120
+
+//log scale histogram buckets for the exit summary, PROF_SUB_BUCKETS per doubling of microseconds
+#define PROF_SUB_BUCKETS 8
+#define PROF_BUCKETS (PROF_SUB_BUCKETS * 24 + 1)
+
+//stages of a frame, each one is the total time spent in it over the frame
+typedef enum {
+
+	PROF_EVENTS,
+	PROF_SIMULATE,
+	PROF_PROJECT,
+	PROF_DRAW_MESH,
+	PROF_TEXT,
+	PROF_CLEAR,
+	PROF_UPDATE_XIMAGE,
+	PROF_PUT_IMAGE,
+	PROF_FLIP,
+	PROF_XSYNC,		//waiting at the end of the frame for the server to finish, only with --xsync
+	PROF_FRAME,		//wall time from the start of one frame to the start of the next, sleep included
+	PROF_STAGE_COUNT
+} ProfStage;
+
+//a stage timed until the variable holding it goes out of scope
+typedef struct {
+
+	ProfStage stage;
+	double start;
+} ProfScope;
+
+//function Prototypes
+double prof_now(void);
+void prof_end(ProfStage stage, double start);
+void prof_frame_begin(void);
+void prof_frame_skip(void);
+void prof_toggle_overlay(void);
+bool prof_overlay_visible(void);
+int prof_reserve_overlay(Fontmap *fm);
+void prof_free_overlay(void);
+int prof_draw_overlay(App *app, Fontmap *fm, int x, int y);
+void prof_print_summary(void);
+
+static inline void prof_scope_end(ProfScope *scope) {
+
+	prof_end(scope->stage, scope->start);
+}
+
+//time the rest of the enclosing block as stage, for functions that are a single stage from top to bottom
+#define PROF_SCOPE(stage) ProfScope prof_scope_ __attribute__((cleanup(prof_scope_end))) = {stage, prof_now()}
+
+#endif
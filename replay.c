@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <string.h>
+#include "replay.h"
+
+static void put_le(FILE *f, uint64_t v, int bytes) {
+
+	for (int i = 0; i < bytes; i++) {
+
+		fputc((int) ((v >> (8 * i)) & 0xff), f);
+	}
+}
+
+//returns 0 when the file ends part way through
+static int get_le(FILE *f, uint64_t *v, int bytes) {
+
+	*v = 0;
+
+	for (int i = 0; i < bytes; i++) {
+
+		int c = fgetc(f);
+
+		if (c == EOF) {
+
+			return 0;
+		}
+
+		*v |= (uint64_t) c << (8 * i);
+	}
+
+	return 1;
+}
+
+//start a new replay file, the header is written straight away
+int replay_record(Replay *r, const char *path, ReplayHeader *header) {
+
+	*r = (Replay) {0};
+	r->file = fopen(path, "wb");
+
+	if (r->file == NULL) {
+
+		printf("Could not open replay file for writing: %s\n", path);
+		return 1;
+	}
+
+	r->header = *header;
+	fwrite(REPLAY_MAGIC, 1, 4, r->file);
+	put_le(r->file, REPLAY_VERSION, 4);
+	put_le(r->file, header->seed, 8);
+	put_le(r->file, (uint32_t) header->wave_size, 4);
+	put_le(r->file, (uint32_t) header->asteroid_capacity, 4);
+	put_le(r->file, (uint32_t) header->asteroid_budget_mb, 4);
+	put_le(r->file, (uint32_t) header->max_bullets, 4);
+
+	return 0;
+}
+
+//open a replay file for playback and read its header into r->header
+int replay_open(Replay *r, const char *path) {
+
+	char magic[4];
+	uint64_t version, seed, wave_size, capacity, budget, bullets;
+
+	*r = (Replay) {0};
+	r->file = fopen(path, "rb");
+
+	if (r->file == NULL) {
+
+		printf("Could not open replay file: %s\n", path);
+		return 1;
+	}
+
+	if (fread(magic, 1, 4, r->file) != 4 || memcmp(magic, REPLAY_MAGIC, 4) != 0 || !get_le(r->file, &version, 4) || version != REPLAY_VERSION) {
+
+		printf("Not a replay file this version can play: %s\n", path);
+		replay_close(r);
+		return 1;
+	}
+
+	if (!get_le(r->file, &seed, 8) || !get_le(r->file, &wave_size, 4) || !get_le(r->file, &capacity, 4) || !get_le(r->file, &budget, 4) || !get_le(r->file, &bullets, 4)) {
+
+		printf("Replay file header is cut short: %s\n", path);
+		replay_close(r);
+		return 1;
+	}
+
+	r->header.seed = seed;
+	r->header.wave_size = (int32_t) wave_size;
+	r->header.asteroid_capacity = (int32_t) capacity;
+	r->header.asteroid_budget_mb = (int32_t) budget;
+	r->header.max_bullets = (int32_t) bullets;
+
+	return 0;
+}
+
+//held buttons go in the low 4 bits and pressed ones in the high 4
+void replay_write(Replay *r, InputFrame in, uint32_t hash) {
+
+	fputc((in.held & 0x0f) | (in.pressed << 4), r->file);
+	put_le(r->file, hash, 4);
+	r->tick++;
+}
+
+//read the next tick, returns 0 at the end of the replay
+int replay_read(Replay *r, InputFrame *in, uint32_t *hash) {
+
+	int c = fgetc(r->file);
+	uint64_t h;
+
+	if (c == EOF || !get_le(r->file, &h, 4)) {
+
+		return 0;
+	}
+
+	in->held = c & 0x0f;
+	in->pressed = (c >> 4) & 0x0f;
+	*hash = (uint32_t) h;
+	r->tick++;
+
+	return 1;
+}
+
+void replay_close(Replay *r) {
+
+	if (r->file != NULL) {
+
+		fclose(r->file);
+	}
+
+	r->file = NULL;
+}
@@ -0,0 +1,37 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "types.h"
+
+#define REPLAY_MAGIC "XTRP"
+#define REPLAY_VERSION 1
+
+//everything besides input that decides how a game plays out, a replay runs with these instead of the command line
+typedef struct {
+
+	uint64_t seed;
+	int32_t wave_size;
+	int32_t asteroid_capacity;
+	int32_t asteroid_budget_mb;
+	int32_t max_bullets;
+} ReplayHeader;
+
+//A replay file is the header followed by one 5 byte record per simulation tick, the input packed
+//into one byte and a hash of the game state after the tick. All numbers are little endian
+typedef struct {
+
+	FILE *file;
+	ReplayHeader header;
+	uint32_t tick;		//ticks written or read so far
+} Replay;
+
+//function Prototypes
+int replay_record(Replay *r, const char *path, ReplayHeader *header);
+int replay_open(Replay *r, const char *path);
+void replay_write(Replay *r, InputFrame in, uint32_t hash);
+int replay_read(Replay *r, InputFrame *in, uint32_t *hash);
+void replay_close(Replay *r);
+
+#endif
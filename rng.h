@@ -0,0 +1,58 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+//PCG32 random number stream (pcg-random.org). Every stream carries its own state so threads can each
+//draw from one without locking, and a seed gives the same sequence on every machine and libc
+typedef struct {
+
+	uint64_t state;		//position in the sequence
+	uint64_t inc;		//odd increment, picks which of the 2^63 sequences this stream walks
+} Rng;
+
+//splitmix64 step, spreads nearby seeds like 1, 2, 3 far apart before they are used
+static inline uint64_t rng_mix(uint64_t x) {
+
+	x += 0x9e3779b97f4a7c15ull;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+
+	return x ^ (x >> 31);
+}
+
+static inline uint32_t rng_next(Rng *r) {
+
+	uint64_t old = r->state;
+
+	r->state = old * 6364136223846793005ull + r->inc;
+
+	uint32_t xorshifted = (uint32_t) (((old >> 18) ^ old) >> 27);
+	uint32_t rot = (uint32_t) (old >> 59);
+
+	return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+//start a stream, different stream ids with the same seed give independent sequences
+static inline void rng_seed(Rng *r, uint64_t seed, uint64_t stream) {
+
+	r->state = 0;
+	r->inc = (rng_mix(stream) << 1) | 1;
+	rng_next(r);
+	r->state += rng_mix(seed);
+	rng_next(r);
+}
+
+//uniform float in [min, max), uses the top 24 bits so every value is exactly representable
+static inline float rng_float(Rng *r, float min, float max) {
+
+	return min + (float) (rng_next(r) >> 8) * (1.0f / 16777216.0f) * (max - min);
+}
+
+//uniform int in [0, n), multiply and shift rather than modulo so small n stay unbiased enough and it needs no divide
+static inline int rng_range(Rng *r, int n) {
+
+	return (int) (((uint64_t) rng_next(r) * (uint32_t) n) >> 32);
+}
+
+#endif
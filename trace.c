@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "trace.h"
+#include "mem.h"
+
+bool trace_enabled = false;
+
+//ring of the current thread, -1 until its first span and -2 if every ring was already taken
+static _Thread_local int ring_id = -1;
+
+static struct {
+
+	const char *path;
+	TraceRing *rings;
+	int ring_count;
+	atomic_int rings_claimed;
+	uint64_t origin;	//timestamps in the file are microseconds since this
+} trace;
+
+//give the current thread the next free ring, threads past the last ring record nothing
+static int claim_ring(void) {
+
+	int id = atomic_fetch_add(&trace.rings_claimed, 1);
+
+	ring_id = (id < trace.ring_count) ? id : -2;
+
+	return ring_id;
+}
+
+//allocate a ring per thread up front so recording never allocates, the calling thread gets ring 0
+int trace_init(const char *path, int thread_count) {
+
+	trace.path = path;
+	trace.ring_count = thread_count;
+	trace.rings = mem_calloc(MEM_OTHER, thread_count, sizeof(TraceRing));
+
+	if (trace.rings == NULL) {
+
+		puts("Could not allocate memory for trace buffers");
+		return 1;
+	}
+
+	for (int i = 0; i < thread_count; i++) {
+
+		trace.rings[i].events = mem_alloc(MEM_OTHER, TRACE_RING_EVENTS * sizeof(TraceEvent));
+
+		if (trace.rings[i].events == NULL) {
+
+			puts("Could not allocate memory for trace buffers");
+			trace.ring_count = i;
+			trace_shutdown();
+			return 1;
+		}
+
+		atomic_init(&trace.rings[i].head, 0);
+	}
+
+	atomic_init(&trace.rings_claimed, 0);
+	trace.origin = trace_now();
+	claim_ring();
+	trace_enabled = true;
+
+	return 0;
+}
+
+void trace_event(const char *name, uint64_t start, uint64_t end) {
+
+	int id = (ring_id == -1) ? claim_ring() : ring_id;
+
+	if (id < 0) {
+
+		return;
+	}
+
+	TraceRing *ring = &trace.rings[id];
+	uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+	ring->events[head & (TRACE_RING_EVENTS - 1)] = (TraceEvent) {name, start, end - start};
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+//write everything still in the rings as Chrome trace event JSON, loads in chrome://tracing and ui.perfetto.dev
+//meant to be called while the workers are idle, a span written during the flush can come out torn
+int trace_flush(void) {
+
+	if (!trace_enabled) {
+
+		return 0;
+	}
+
+	FILE *f = fopen(trace.path, "w");
+
+	if (f == NULL) {
+
+		printf("Could not write trace to %s\n", trace.path);
+		return 1;
+	}
+
+	int claimed = atomic_load(&trace.rings_claimed);
+	int used = (claimed < trace.ring_count) ? claimed : trace.ring_count;
+	uint64_t spans = 0;
+
+	fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+	fprintf(f, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"xteroids\"}}");
+
+	for (int t = 0; t < used; t++) {
+
+		TraceRing *ring = &trace.rings[t];
+		uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+		uint64_t first = (head > TRACE_RING_EVENTS) ? head - TRACE_RING_EVENTS : 0;
+
+		if (t == 0) {
+
+			fprintf(f, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"main\"}}");
+
+		} else {
+
+			fprintf(f, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"worker %d\"}}", t, t);
+		}
+
+		for (uint64_t i = first; i < head; i++) {
+
+			TraceEvent *e = &ring->events[i & (TRACE_RING_EVENTS - 1)];
+
+			//spans that started before the trace did would have a negative time
+			if (e->start < trace.origin) {
+
+				continue;
+			}
+
+			fprintf(f, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}", e->name, t, (e->start - trace.origin) / 1000.0, e->duration / 1000.0);
+		}
+
+		spans += head - first;
+	}
+
+	fprintf(f, "\n]}\n");
+	fclose(f);
+	printf("wrote %llu trace spans from %d threads to %s\n", (unsigned long long) spans, used, trace.path);
+
+	return 0;
+}
+
+//write the trace a last time and free the rings
+void trace_shutdown(void) {
+
+	if (trace_enabled) {
+
+		trace_flush();
+	}
+
+	trace_enabled = false;
+
+	for (int i = 0; i < trace.ring_count; i++) {
+
+		mem_free(trace.rings[i].events);
+	}
+
+	mem_free(trace.rings);
+	trace.rings = NULL;
+	trace.ring_count = 0;
+}
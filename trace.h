@@ -0,0 +1,73 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+
+//spans kept per thread, a power of 2, once a ring is full the oldest spans are written over
+#define TRACE_RING_EVENTS (1 << 16)
+
+//one finished span, name must be a string that lives for the whole run
+typedef struct {
+
+	const char *name;
+	uint64_t start;		//nanoseconds on CLOCK_MONOTONIC
+	uint64_t duration;
+} TraceEvent;
+
+//Each thread writes only to its own ring so recording takes no lock. The owner fills the slot then
+//publishes it by moving head, the flush reads head and the slots behind it
+typedef struct {
+
+	TraceEvent *events;
+	_Atomic uint64_t head;	//spans ever written, the newest is at head - 1
+	char pad[64 - sizeof(TraceEvent *) - sizeof(uint64_t)];
+} TraceRing;
+
+//a span that is closed when the variable holding it goes out of scope
+typedef struct {
+
+	const char *name;
+	uint64_t start;		//0 when tracing was off as the span opened
+} TraceScope;
+
+//set by trace_init, checked before anything is recorded so tracing costs one branch when off
+extern bool trace_enabled;
+
+//function Prototypes
+int trace_init(const char *path, int thread_count);
+void trace_event(const char *name, uint64_t start, uint64_t end);
+int trace_flush(void);
+void trace_shutdown(void);
+
+static inline uint64_t trace_now(void) {
+
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static inline TraceScope trace_scope_begin(const char *name) {
+
+	return (TraceScope) {name, trace_enabled ? trace_now() : 0};
+}
+
+static inline void trace_scope_end(TraceScope *scope) {
+
+	if (scope->start != 0) {
+
+		trace_event(scope->name, scope->start, trace_now());
+	}
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+//record a span named name from here to the end of the enclosing block
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__) __attribute__((cleanup(trace_scope_end))) = trace_scope_begin(name)
+
+#endif
@@ -3,6 +3,10 @@
 
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
+#include "pool.h"
+#include "grid.h"
+#include "arena.h"
+#include "rng.h"
 
 typedef enum {
 
@@ -20,14 +24,33 @@ typedef struct {
 	Pixmap buffer;		//back buffer for double buffering
 	XImage *ximage;		//Xlibs wrapper for the pixel buffer
 	uint32_t *pixel_buffer;	//raw pixel buffer to draw to for pixel effects
+	uint8_t *index_buffer;	//8 bit palette indexed pixel buffer, replaces pixel_buffer in indexed mode
+	uint32_t palette[256];	//ARGB colour of each palette index
+	int palette_count;	//number of palette entries in use
+	bool indexed;		//set before init_x to draw palette indices and expand them in update_ximage
+	bool native_resolution;	//set before init_x to keep the pixel buffer the same size as the window
+	bool direct;		//the pixel buffer is the XImage data, it matches the window so there is no scale pass
+	uint64_t *rows_used;	//bitmap of pixel buffer rows drawn to this frame
+	uint64_t *rows_used_prev;	//bitmap of pixel buffer rows drawn to last frame
+	bool ximage_stale;	//ximage rows can't be reused, every row is rewritten on the next update_ximage
+	uint32_t ximage_fill;	//colour empty ximage rows were last filled with
+	bool pixels_cleared;	//update_ximage cleared every pixel buffer row after reading it, clear_screen has nothing to do
+	bool redraw;		//the window was exposed or resized, a static screen has to be drawn again
 	int screen;		//which monitor the window will be on
 	int width;		//width of window
 	int height;		//height of window
-	int pixel_buffer_w;	//width of pixel buffer
-	int pixel_buffer_h;	//height of pixel buffer
+	int pixel_buffer_w;	//width of pixel buffer, PBUF_WIDTH unless set before init_x
+	int pixel_buffer_h;	//height of pixel buffer, PBUF_HEIGHT unless set before init_x
 	Atom wmDeleteMessage;
 } App;
 
+//a horizontal run of opaque pixels in a sprite row
+typedef struct {
+
+	uint16_t start;		//x offset of the first pixel in the run
+	uint16_t len;		//number of pixels in the run
+} SpriteSpan;
+
 //This struct holds sprite data
 typedef struct {
 
@@ -35,6 +58,11 @@ typedef struct {
 	int width;
 	int height;
 	int channels;
+	SpriteSpan *spans;	//opaque runs of every row, built by sprite_build_spans
+	int *row_spans;		//index of the first span of each row, row_spans[height] is the span count
+	uint32_t *premul;	//premultiplied alpha copy of pixels used by draw_sprite_blend
+	uint8_t *indices;	//palette indices of pixels for indexed mode, built on first draw
+	bool indices_stale;	//pixels changed since the indices were built
 } Sprite;
 
 //this struct holds bitmap font data
@@ -44,9 +72,27 @@ typedef struct {
 	char *f_map; 
 	int char_width;
 	int char_height;
+	int row_bytes;			//bytes per packed glyph row ((char_width + 7) / 8)
+	int glyph_count;		//number of char cells in the sprite sheet
+	uint16_t glyph_index[256];	//char to glyph cell lookup table built by load_font
+	uint8_t *glyph_masks;		//1 bit per pixel glyph rows (bit 0 is the leftmost pixel)
 	Sprite font_buffer;
 } Fontmap;
 
+//max length of a string that can be cached as a text run, long enough for every line of the profiler overlay
+#define TEXT_RUN_MAX 96
+
+//this struct holds a string rasterized once into a sprite so it can be drawn with a single blit
+typedef struct {
+
+	Fontmap *font;			//font the run was rendered with
+	char text[TEXT_RUN_MAX];	//string currently rendered into the sprite
+	int len;			//number of chars in text
+	int capacity;			//chars the sprite buffers have room for, set by text_run_reserve
+	Sprite sprite;			//rendered glyphs, transparent pixels have a 0 alpha byte
+	bool pinned;			//handed out by text_run_get, the cache never reuses it
+} TextRun;
+
 //this struct discribes a 3D vector
 typedef struct {
 	
@@ -60,13 +106,14 @@ typedef struct {
 typedef struct {
 	
 	Vector3 *local_verts;	//Array of Vector3 structs to store the X,Y,Z positions of a vertex
-	Vector3 *screen_verts;	//array holding the 2D screen space position of the 2d projected models vertices
 	Vector3 direction;	//vector that holds the direction vector of the model
 	Vector3 rotation;	//vector that holds the direction the model is facing
 	Vector3 position;	//vector that holds the position of the model in world space
 	Vector3 velocity;	//vector that describes the rate of change model will move in relative to its position
 	Vector3 acceleration;	//vector that describes the rate of change of the velocity
 	Vector3 scale;		//vector that describes scale of each axis
+	Vector3 prev_position;	//position at the start of the last simulation tick, used to interpolate rendering
+	Vector3 prev_rotation;	//rotation at the start of the last simulation tick, used to interpolate rendering
 	int *facev;		//Array to store how many vertices each face has (3, 4, 5 ...  N faces)
 	int *meshf;		//Array of all the vertex indices for every face in the mesh
 	int local_count;	//int to store how many elements are in the vertex_array
@@ -81,19 +128,76 @@ typedef struct {
 	int lives;
 } Ship;
 
+//Structure of arrays storage for every asteroid. The per asteroid dynamic state lives in flat arrays
+//so the update pass streams through memory, all asteroids share a single mesh
 typedef struct {
 
-	Model3D model;
-	asteroid_size_t size;
-	int spin;
-	bool alive;
-} Asteroid;
+	float *pos_x;		//position in world space
+	float *pos_y;
+	float *prev_x;		//position at the start of the last simulation tick
+	float *prev_y;
+	float *vel_x;		//distance moved every tick
+	float *vel_y;
+	float *rot_z;		//rotation about the z axis
+	float *prev_rot_z;	//rotation at the start of the last simulation tick
+	float *spin;		//rotation added every tick
+	float *scale;		//the scale in pixels at which the asteroid is rendered at
+	uint8_t *size;		//asteroid_size_t of each asteroid
+	int *next_cell;		//broadphase cell each asteroid belongs in this tick, found in parallel before the grid is relinked
+	int count;		//one past the highest slot ever handed out, SIMD passes run up to here
+	int capacity;		//number of slots allocated, a multiple of 8 so SIMD passes never run off the end
+	int initial_capacity;	//number of slots a new wave starts with, the field doubles when it runs out
+	int wave_size;		//number of large asteroids in a new wave
+	uint64_t seed;		//seed the current wave was started from
+	Rng rng;		//stream the wave layout and every fragment's heading and spin are drawn from
+	Pool pool;		//which slots hold live asteroids
+	Grid grid;		//broadphase holding every live asteroid
+	Arena *arena;		//the session arena, every array above is allocated from it and its budget caps how far the field can grow
+	int grow_count;		//number of times the field has doubled
+	int peak_live;		//most asteroids alive at once
+	int dropped;		//fragments that could not be spawned because the arena budget ran out
+	bool full;		//a grow ran out of budget, no more are tried until the next wave
+	Model3D mesh;		//mesh shared by every asteroid, loaded once
+	float outline_radius;	//distance of the furthest mesh vertex from the centre at scale 1, the bounding circle for collisions
+} AsteroidField;
 
 typedef struct {
 
 	Model3D model;
-	bool alive;
 	float time_alive;
 } Bullet;
 
+//an asteroid destroyed this tick, it is split into fragments once every hit has been applied
+typedef struct {
+
+	Vector3 position;
+	asteroid_size_t size;
+} AsteroidSplit;
+
+typedef struct {
+
+	Bullet *items;
+	int *hit;		//asteroid each bullet hit this tick or -1, found in parallel before any hit is applied
+	AsteroidSplit *splits;	//asteroids destroyed this tick, at most one per bullet
+	Pool pool;		//which bullets are in flight
+	Arena *arena;		//the session arena the arrays above are allocated from at the start of every game
+	int capacity;
+} BulletPool;
+
+//buttons the simulation reacts to, one bit each
+typedef enum {
+
+	INPUT_LEFT = 1,
+	INPUT_RIGHT = 2,
+	INPUT_THRUST = 4,
+	INPUT_FIRE = 8
+} InputButton;
+
+//input for one simulation tick, this is all a tick reads so recording it is enough to replay a game
+typedef struct {
+
+	uint8_t held;		//InputButton bits held down during the tick
+	uint8_t pressed;	//InputButton bits pressed since the last tick
+} InputFrame;
+
 #endif
@@ -119,11 +119,55 @@ static inline Vector3 v3_normalise(Vector3 v) {
 //}
 
 
+//sine and cosine of a from a local polynomial rather than libm, whose sinf and cosf differ between versions.
+//The simulation takes every angle through here so a seed and its inputs replay bit for bit on any libm
+static inline void sim_sincos(float a, float *s, float *c) {
+
+	//reduce to within pi/4 of the nearest quarter turn, pi/2 is split in three parts short enough that each product
+	//with the turn count is exact, so angles that have spun on for a long game keep their accuracy
+	float q = rintf(a * 0.63661977236f);
+	float x = ((a - q * 1.5703125f) - q * 4.837512969970703125e-4f) - q * 7.54978995489188216e-8f;
+	float z = x * x;
+
+	//minimax fits over [-pi/4, pi/4] from cephes
+	float sx = ((-1.9515295891e-4f * z + 8.3321608736e-3f) * z - 1.6666654611e-1f) * z * x + x;
+	float cx = ((2.443315711809948e-5f * z - 1.388731625493765e-3f) * z + 4.166664568298827e-2f) * z * z - 0.5f * z + 1.0f;
+
+	switch ((int) q & 3) {
+
+		case 0:
+			
+			*s = sx;
+			*c = cx;
+			break;
+
+		case 1:
+			
+			*s = cx;
+			*c = -sx;
+			break;
+
+		case 2:
+			
+			*s = -sx;
+			*c = -cx;
+			break;
+
+		default:
+			
+			*s = -cx;
+			*c = sx;
+			break;
+	}
+}
+
 static inline Vector3 v3_rotate(Vector3 v, Vector3 a) {
  
-	float cx = cosf(a.x), sx = sinf(a.x);
-	float cy = cosf(a.y), sy = sinf(a.y);
-	float cz = cosf(a.z), sz = sinf(a.z);
+	float cx, sx, cy, sy, cz, sz;
+
+	sim_sincos(a.x, &sx, &cx);
+	sim_sincos(a.y, &sy, &cy);
+	sim_sincos(a.z, &sz, &cz);
 
 	Vector3 res;
 
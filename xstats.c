@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <string.h>
+#include "graphics.h"
+#include "xstats.h"
+
+//fixed size in bytes of each request in the X11 protocol, drawing calls add 8 or 12 bytes per shape on top
+#define REQ_POLY_SEGMENT 12
+#define REQ_POLY_FILL_ARC 12
+#define REQ_POLY_FILL_RECTANGLE 12
+#define REQ_PUT_IMAGE 24
+#define REQ_COPY_AREA 28
+#define REQ_INTERN_ATOM 8
+
+static const char *call_names[XC_CALL_COUNT] = {
+
+	"XSetForeground", "XSetLineAttributes", "XDrawLine", "XFillArc", "XFillRectangle", "XPutImage", "XCopyArea", "XFlush", "XPending", "XSync", "XInternAtom"
+};
+
+//Xlib buffers requests and batches them, so calls, requests and bytes all differ. Requests are read off
+//the connections sequence number, bytes are worked out from the protocol sizes of what each call sent
+typedef struct {
+
+	uint32_t calls[XC_CALL_COUNT];
+	uint32_t requests;
+	uint64_t bytes;
+	uint32_t round_trips;		//calls that blocked until the server replied
+} XFrameStats;
+
+static struct {
+
+	XFrameStats current;
+	XFrameStats last;			//the last finished frame, shown in the overlay
+	uint64_t total_calls[XC_CALL_COUNT];
+	uint64_t total_requests;
+	uint64_t total_bytes;
+	uint64_t total_round_trips;
+	uint32_t max_requests;
+	uint64_t max_bytes;
+	unsigned long first_request;		//sequence number of the first request of this frame
+	int frames;
+	bool started;
+	TextRun line;				//held run of the overlay line
+} xstats;
+
+//count a call, requests is how far it moved the sequence number, a GC change Xlib held back goes out with the next drawing call
+static void count(XCall call, unsigned long requests, unsigned long header, unsigned long payload) {
+
+	xstats.current.calls[call]++;
+	xstats.current.bytes += requests * header + payload;
+}
+
+//close the last frame and start counting a new one, call once at the top of the main loop
+void xstats_frame_begin(Display *d) {
+
+	unsigned long next = XNextRequest(d);
+
+	if (xstats.started) {
+
+		XFrameStats *f = &xstats.current;
+
+		f->requests = (uint32_t) (next - xstats.first_request);
+
+		for (int c = 0; c < XC_CALL_COUNT; c++) {
+
+			xstats.total_calls[c] += f->calls[c];
+		}
+
+		xstats.total_requests += f->requests;
+		xstats.total_bytes += f->bytes;
+		xstats.total_round_trips += f->round_trips;
+		xstats.max_requests = (f->requests > xstats.max_requests) ? f->requests : xstats.max_requests;
+		xstats.max_bytes = (f->bytes > xstats.max_bytes) ? f->bytes : xstats.max_bytes;
+		xstats.last = *f;
+		xstats.frames++;
+	}
+
+	xstats.current = (XFrameStats) {0};
+	xstats.first_request = next;
+	xstats.started = true;
+}
+
+//size the run of the overlay line up front like prof_reserve_overlay, returns 1 if it could not be allocated
+int xstats_reserve_overlay(Fontmap *fm) {
+
+	return text_run_reserve(&xstats.line, fm, TEXT_RUN_MAX - 1);
+}
+
+void xstats_free_overlay(void) {
+
+	text_run_free(&xstats.line);
+}
+
+//one line under the frame profiler overlay with what the last frame sent to the server
+void xstats_draw_overlay(App *app, Fontmap *fm, int x, int y) {
+
+	char line[128];
+	uint32_t calls = 0;
+
+	for (int c = 0; c < XC_CALL_COUNT; c++) {
+
+		calls += xstats.last.calls[c];
+	}
+
+	snprintf(line, sizeof(line), "X %u calls %u requests %.1f KB %u round trips", calls, xstats.last.requests, xstats.last.bytes / 1024.0, xstats.last.round_trips);
+
+	if (text_run_set(&xstats.line, fm, line) == 0) {
+
+		draw_text_run(app, &xstats.line, x, y);
+
+	} else {
+
+		draw_string(app, fm, line, x, y);
+	}
+}
+
+void xstats_print_summary(void) {
+
+	if (xstats.frames == 0) {
+
+		return;
+	}
+
+	printf("X calls over %d frames\n", xstats.frames);
+	printf("%-20s %12s %10s\n", "call", "total", "per frame");
+
+	for (int c = 0; c < XC_CALL_COUNT; c++) {
+
+		if (xstats.total_calls[c] > 0) {
+
+			printf("%-20s %12llu %10.1f\n", call_names[c], (unsigned long long) xstats.total_calls[c], (double) xstats.total_calls[c] / xstats.frames);
+		}
+	}
+
+	printf("requests per frame %.1f average, %u max\n", (double) xstats.total_requests / xstats.frames, xstats.max_requests);
+	printf("bytes queued per frame %.1f KB average, %.1f KB max\n", xstats.total_bytes / 1024.0 / xstats.frames, xstats.max_bytes / 1024.0);
+	printf("round trips %llu\n", (unsigned long long) xstats.total_round_trips);
+}
+
+//GC changes are cached by Xlib and only sent with the next drawing request that uses the GC
+int x_set_foreground(Display *d, GC gc, unsigned long colour) {
+
+	count(XC_SET_FOREGROUND, 0, 0, 0);
+
+	return XSetForeground(d, gc, colour);
+}
+
+int x_set_line_attributes(Display *d, GC gc, unsigned int width, int line_style, int cap_style, int join_style) {
+
+	count(XC_SET_LINE_ATTRIBUTES, 0, 0, 0);
+
+	return XSetLineAttributes(d, gc, width, line_style, cap_style, join_style);
+}
+
+//a line right after another on the same drawable and GC is added to the same PolySegment request
+int x_draw_line(Display *d, Drawable drawable, GC gc, int x1, int y1, int x2, int y2) {
+
+	unsigned long before = XNextRequest(d);
+	int r = XDrawLine(d, drawable, gc, x1, y1, x2, y2);
+
+	count(XC_DRAW_LINE, XNextRequest(d) - before, REQ_POLY_SEGMENT, 8);
+
+	return r;
+}
+
+int x_fill_arc(Display *d, Drawable drawable, GC gc, int x, int y, unsigned int width, unsigned int height, int angle1, int angle2) {
+
+	unsigned long before = XNextRequest(d);
+	int r = XFillArc(d, drawable, gc, x, y, width, height, angle1, angle2);
+
+	count(XC_FILL_ARC, XNextRequest(d) - before, REQ_POLY_FILL_ARC, 12);
+
+	return r;
+}
+
+int x_fill_rectangle(Display *d, Drawable drawable, GC gc, int x, int y, unsigned int width, unsigned int height) {
+
+	unsigned long before = XNextRequest(d);
+	int r = XFillRectangle(d, drawable, gc, x, y, width, height);
+
+	count(XC_FILL_RECTANGLE, XNextRequest(d) - before, REQ_POLY_FILL_RECTANGLE, 8);
+
+	return r;
+}
+
+//an image bigger than the largest request the server takes is split over several PutImage requests
+int x_put_image(Display *d, Drawable drawable, GC gc, XImage *image, int src_x, int src_y, int dest_x, int dest_y, unsigned int width, unsigned int height) {
+
+	unsigned long before = XNextRequest(d);
+	int r = XPutImage(d, drawable, gc, image, src_x, src_y, dest_x, dest_y, width, height);
+	unsigned long row_bytes = ((unsigned long) width * image->bits_per_pixel + 31) / 32 * 4;
+
+	count(XC_PUT_IMAGE, XNextRequest(d) - before, REQ_PUT_IMAGE, row_bytes * height);
+
+	return r;
+}
+
+int x_copy_area(Display *d, Drawable src, Drawable dest, GC gc, int src_x, int src_y, unsigned int width, unsigned int height, int dest_x, int dest_y) {
+
+	unsigned long before = XNextRequest(d);
+	int r = XCopyArea(d, src, dest, gc, src_x, src_y, width, height, dest_x, dest_y);
+
+	count(XC_COPY_AREA, XNextRequest(d) - before, REQ_COPY_AREA, 0);
+
+	return r;
+}
+
+int x_flush(Display *d) {
+
+	count(XC_FLUSH, 0, 0, 0);
+
+	return XFlush(d);
+}
+
+//flushes and reads what has already arrived, it does not wait on the server
+int x_pending(Display *d) {
+
+	count(XC_PENDING, 0, 0, 0);
+
+	return XPending(d);
+}
+
+//waits until the server has processed every request sent so far
+int x_sync(Display *d) {
+
+	unsigned long before = XNextRequest(d);
+	int r = XSync(d, False);
+
+	count(XC_SYNC, XNextRequest(d) - before, 4, 0);
+	xstats.current.round_trips++;
+
+	return r;
+}
+
+//the server has to answer with the atom, unless Xlib already has it cached and sends nothing
+Atom x_intern_atom(Display *d, const char *name, Bool only_if_exists) {
+
+	unsigned long before = XNextRequest(d);
+	Atom atom = XInternAtom(d, name, only_if_exists);
+	unsigned long requests = XNextRequest(d) - before;
+
+	count(XC_INTERN_ATOM, requests, REQ_INTERN_ATOM, (requests > 0) ? (strlen(name) + 3) / 4 * 4 : 0);
+	xstats.current.round_trips += requests;
+
+	return atom;
+}
@@ -0,0 +1,41 @@
+#ifndef XSTATS_H
+#define XSTATS_H
+
+#include "types.h"
+
+//X calls that are counted, every call in the frame loop goes through one of the wrappers below
+typedef enum {
+
+	XC_SET_FOREGROUND,
+	XC_SET_LINE_ATTRIBUTES,
+	XC_DRAW_LINE,
+	XC_FILL_ARC,
+	XC_FILL_RECTANGLE,
+	XC_PUT_IMAGE,
+	XC_COPY_AREA,
+	XC_FLUSH,
+	XC_PENDING,
+	XC_SYNC,
+	XC_INTERN_ATOM,
+	XC_CALL_COUNT
+} XCall;
+
+//function Prototypes
+void xstats_frame_begin(Display *d);
+int xstats_reserve_overlay(Fontmap *fm);
+void xstats_free_overlay(void);
+void xstats_draw_overlay(App *app, Fontmap *fm, int x, int y);
+void xstats_print_summary(void);
+int x_set_foreground(Display *d, GC gc, unsigned long colour);
+int x_set_line_attributes(Display *d, GC gc, unsigned int width, int line_style, int cap_style, int join_style);
+int x_draw_line(Display *d, Drawable drawable, GC gc, int x1, int y1, int x2, int y2);
+int x_fill_arc(Display *d, Drawable drawable, GC gc, int x, int y, unsigned int width, unsigned int height, int angle1, int angle2);
+int x_fill_rectangle(Display *d, Drawable drawable, GC gc, int x, int y, unsigned int width, unsigned int height);
+int x_put_image(Display *d, Drawable drawable, GC gc, XImage *image, int src_x, int src_y, int dest_x, int dest_y, unsigned int width, unsigned int height);
+int x_copy_area(Display *d, Drawable src, Drawable dest, GC gc, int src_x, int src_y, unsigned int width, unsigned int height, int dest_x, int dest_y);
+int x_flush(Display *d);
+int x_pending(Display *d);
+int x_sync(Display *d);
+Atom x_intern_atom(Display *d, const char *name, Bool only_if_exists);
+
+#endif
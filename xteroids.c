@@ -4,6 +4,15 @@
 #include <unistd.h>
 #include <time.h>
 #include "graphics.h"
+#include "jobs.h"
+#include "replay.h"
+#include "profile.h"
+#include "trace.h"
+#include "xstats.h"
+#include "mem.h"
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 #define SCREEN_WIDTH 1920
 #define SCREEN_HEIGHT 1080
@@ -11,8 +20,21 @@
 #define Z_OFFSET 500.0f
 #define FOCAL_LENGTH 500.0f
 
-#define NUM_ASTEROIDS 39
-#define NUM_BULLETS 4
+//default pool sizes, 39 asteroids is exactly enough for 3 large ones to split all the way down
+//the asteroid field grows past this on its own until the session arena hits its memory budget
+#define DEFAULT_ASTEROID_CAPACITY 39
+#define DEFAULT_ASTEROID_BUDGET_MB 64
+#define DEFAULT_WAVE_SIZE 3
+#define DEFAULT_MAX_BULLETS 4
+
+//seed of the first wave, each restart moves on to the next one
+#define DEFAULT_SEED 1
+
+//everything one play-through allocates comes from the session arena, a new game resets it
+#define SESSION_ARENA_BLOCK (1 << 20)
+
+//scratch memory for one frame, the blocks are kept from frame to frame so a steady frame never allocates
+#define FRAME_ARENA_BLOCK (64 << 10)
 
 #define SHIP_SPEED_LIMIT 3.5f
 #define SHIP_ACCEL 0.035f
@@ -20,21 +42,59 @@
 
 #define TWO_PI 6.28318530717958647692f
 
-void process_events(App *app, Ship *ship, Ship *lives, Asteroid *asteroids, Bullet *bullets, XEvent *ev, int *running);
-void project(Model3D *model, float hw, float hh);
-void draw_mesh(App *app, Model3D *model);
+//broadphase cell size, must be at least the largest ship + asteroid radius
+#define GRID_CELL 120.0f
+#define MAX_ASTEROID_RADIUS 60.0f
+
+//the simulation always advances in fixed ticks, rendering interpolates between the last two
+#define SIM_HZ 60
+#define SIM_DT (1.0 / SIM_HZ)
+#define MAX_CATCHUP_TICKS 5
+
+//longest a static screen sleeps waiting for input before the loop wakes up and ticks again
+#define IDLE_WAKE 1.0
+
+//ticks run every frame when a replay is played back as fast as possible
+#define REPLAY_FAST_TICKS 64
+
+//--bench-sim defaults, the bullet pool is big enough for a shot every tick over a bullets whole lifetime
+#define DEFAULT_BENCH_TICKS 600
+#define BENCH_MAX_BULLETS 64
+
+//items handed to each simulation job, the asteroid grain is a multiple of 8 so jobs run whole AVX2 blocks
+#define ASTEROID_JOB_GRAIN 16384
+#define BULLET_JOB_GRAIN 256
+
+int process_events(App *app, InputFrame *input, XEvent *ev, int *running);
+int simulate_tick(JobSystem *jobs, Ship *ship, AsteroidField *asteroids, BulletPool *bullets, InputFrame in);
+int press_fire(Ship *ship, AsteroidField *asteroids, BulletPool *bullets);
+void apply_input(Ship *ship, InputFrame in);
+uint32_t state_hash(Ship *ship, AsteroidField *asteroids, BulletPool *bullets);
+void save_state(Model3D *model);
+Vector3 lerp_position(Model3D *model, float alpha);
+void project(Model3D *model, Vector3 *screen_verts, float hw, float hh, float alpha);
+void draw_mesh(App *app, Model3D *model, Vector3 *screen_verts);
+void draw_model(App *app, Arena *frame, Model3D *model, float hw, float hh, float alpha);
 void setModelDirection(Model3D *model, float amount);
 void update_ship(Ship *ship);
-void update_asteroids(Asteroid *asteroids);
-void update_bullets(Bullet *bullets, double delta_time);
+void update_asteroids(JobSystem *jobs, AsteroidField *asteroids);
+static void asteroid_save_job(void *data, int begin, int end);
+void update_bullets(BulletPool *bullets, double delta_time);
 void init_ship(Ship *ship);
-void init_asteroids(Asteroid *asteroids);
-void init_bullets(Bullet *bullets);
-void draw_asteroids(App *app, Asteroid *asteroids, int hw, int hh);
-void draw_bullets(App *app, Bullet *bullets, int hw, int hh);
-void draw_lives(App *app, Ship *lives, int num_lives, int hw, int hh);
-void check_collisions(Ship *ship, Asteroid *asteroids, Bullet *bullets);
-float random_float(float min, float max);
+void reset_ship(Ship *ship);
+int asteroid_field_alloc(AsteroidField *asteroids, Arena *arena, int capacity, int wave_size);
+void asteroid_field_free(AsteroidField *asteroids);
+int add_asteroid(AsteroidField *asteroids, Rng *rng, float x, float y, asteroid_size_t a_size);
+void remove_asteroid(AsteroidField *asteroids, int id);
+int init_asteroids(AsteroidField *asteroids, uint64_t seed);
+void bullet_pool_alloc(BulletPool *bullets, Arena *arena, int capacity);
+int init_bullets(BulletPool *bullets);
+int new_game(Ship *ship, AsteroidField *asteroids, BulletPool *bullets, uint64_t seed);
+void draw_asteroids(App *app, Arena *frame, AsteroidField *asteroids, int hw, int hh, float alpha);
+void draw_bullets(App *app, BulletPool *bullets, int hw, int hh, float alpha);
+void draw_lives(App *app, Arena *frame, Ship *lives, int num_lives, int hw, int hh);
+void check_collisions(JobSystem *jobs, Ship *ship, AsteroidField *asteroids, BulletPool *bullets);
+void free_game(JobSystem *jobs, Ship *ship, AsteroidField *asteroids, Arena *arena);
 
 typedef enum {
     TITLE_SCREEN, 
@@ -46,6 +106,64 @@ typedef enum {
 GameState current_state = TITLE_SCREEN;
 static bool keys[65536];
 
+//stages of a game tick that can be timed
+typedef enum {
+
+	STAGE_COLLISIONS,
+	STAGE_SHIP,
+	STAGE_ASTEROIDS,
+	STAGE_BULLETS,
+	STAGE_COUNT
+} SimStage;
+
+//when set, simulate_tick stores the seconds each stage of a game tick took here
+static double *stage_seconds = NULL;
+
+//run one stage of a game tick, timing it when stage_seconds is set
+#define RUN_STAGE(stage, call) do { \
+	if (stage_seconds == NULL) { \
+		call; \
+	} else { \
+		double stage_start_ = get_time_seconds(); \
+		call; \
+		stage_seconds[stage] = get_time_seconds() - stage_start_; \
+	} \
+} while (0)
+
+//how the bench ship flies
+typedef enum {
+
+	AUTOPILOT_IDLE,		//sits in the centre and never fires
+	AUTOPILOT_SPIN,		//turns on the spot firing in a circle
+	AUTOPILOT_WEAVE		//turns one way then the other with thrust on, firing as it goes
+} Autopilot;
+
+//a scene for --bench-sim
+typedef struct {
+
+	const char *name;
+	int asteroids;		//large asteroids in every wave
+	int capacity;		//asteroid slots the field starts with
+	int fire_every;		//ticks between shots, 0 never fires
+	Autopilot autopilot;
+} BenchPreset;
+
+static const BenchPreset bench_presets[] = {
+
+	//the standard game, the big scenes start with twice their wave size of room so splitting rarely has to grow the field mid run
+	{"39", DEFAULT_WAVE_SIZE, DEFAULT_ASTEROID_CAPACITY, 15, AUTOPILOT_SPIN},
+	{"1k", 1000, 2000, 6, AUTOPILOT_WEAVE},
+	{"10k", 10000, 20000, 3, AUTOPILOT_WEAVE},
+	{"100k", 100000, 200000, 2, AUTOPILOT_WEAVE},
+	{"1m", 1000000, 2000000, 1, AUTOPILOT_WEAVE},
+	{"idle-1m", 1000000, 2000000, 0, AUTOPILOT_IDLE}
+};
+
+static const char *stage_names[STAGE_COUNT] = {"check_collisions", "update_ship", "update_asteroids", "update_bullets"};
+
+const BenchPreset *find_bench_preset(const char *name);
+int bench_sim(JobSystem *jobs, Ship *ship, AsteroidField *asteroids, BulletPool *bullets, const BenchPreset *preset, int ticks, const char *json_path);
+
 // Helper to get time in seconds
 double get_time_seconds() {
 
@@ -55,24 +173,221 @@ double get_time_seconds() {
 	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
 }
 
-int main () {
+int main (int argc, char *argv[]) {
 
-	App app;
+	App app = {0};
 	Ship ship;
 	Ship lives;
 	Model3D title = {0};
-	Asteroid asteroids[NUM_ASTEROIDS];
-	Bullet bullets[NUM_BULLETS];
+	AsteroidField asteroids = {0};
+	BulletPool bullets = {0};
 	Fontmap fontmap;
+	int max_fps = 60;
+	int asteroid_capacity = DEFAULT_ASTEROID_CAPACITY;
+	int asteroid_budget_mb = DEFAULT_ASTEROID_BUDGET_MB;
+	int wave_size = DEFAULT_WAVE_SIZE;
+	bool stress = false;
+	Arena session_arena;
+	Arena frame_arena;
+	int max_bullets = DEFAULT_MAX_BULLETS;
+	int threads = jobs_default_threads();
+	uint64_t seed = DEFAULT_SEED;
+	char *record_path = NULL;
+	char *play_path = NULL;
+	bool play_fast = false;
+	Replay replay = {0};
+	InputFrame input = {0};
+	int exit_code = 0;
+	const BenchPreset *bench = NULL;
+	int bench_ticks = DEFAULT_BENCH_TICKS;
+	char *bench_json = NULL;
+	char *trace_path = NULL;
+	bool xsync = false;
+	bool alloc_check = false;
+	JobSystem jobs;
 	char *f_map = "abcdefghijklmnopqrstuvwxyz      ABCDEFGHIJKLMNOPQRSTUVWXYZ      0123456789.:,;(*!?'/\\\")$%^&-+@~#";
+
+	//command line options
+	for (int i = 1; i < argc; i++) {
+		
+		if (strcmp(argv[i], "--indexed") == 0) {
+			
+			app.indexed = true;
+
+		} else if (strcmp(argv[i], "--resolution") == 0 && i + 1 < argc) {
+			
+			i++;
+
+			if (strcmp(argv[i], "native") == 0) {
+				
+				app.native_resolution = true;
+
+			} else if (sscanf(argv[i], "%dx%d", &app.pixel_buffer_w, &app.pixel_buffer_h) != 2 || app.pixel_buffer_w <= 0 || app.pixel_buffer_h <= 0 || app.pixel_buffer_w > PBUF_MAX_SIDE || app.pixel_buffer_h > PBUF_MAX_SIDE) {
+				
+				printf("bad resolution: %s, expected WIDTHxHEIGHT up to %dx%d or native\n", argv[i], PBUF_MAX_SIDE, PBUF_MAX_SIDE);
+				return 1;
+			}
+
+		} else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+			
+			max_fps = atoi(argv[++i]);
+
+		} else if (strcmp(argv[i], "--asteroid-capacity") == 0 && i + 1 < argc) {
+			
+			asteroid_capacity = atoi(argv[++i]);
+
+		} else if (strcmp(argv[i], "--asteroid-budget") == 0 && i + 1 < argc) {
+			
+			asteroid_budget_mb = atoi(argv[++i]);
+
+		} else if (strcmp(argv[i], "--stress") == 0 && i + 1 < argc) {
+			
+			wave_size = atoi(argv[++i]);
+			stress = true;
+
+		} else if (strcmp(argv[i], "--max-bullets") == 0 && i + 1 < argc) {
+			
+			max_bullets = atoi(argv[++i]);
+
+		} else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			
+			threads = atoi(argv[++i]);
+
+		} else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+			
+			seed = strtoull(argv[++i], NULL, 10);
+
+		} else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+			
+			record_path = argv[++i];
+
+		} else if (strcmp(argv[i], "--play") == 0 && i + 1 < argc) {
+			
+			play_path = argv[++i];
+
+		} else if (strcmp(argv[i], "--play-fast") == 0) {
+			
+			play_fast = true;
+
+		} else if (strcmp(argv[i], "--bench-sim") == 0 && i + 1 < argc) {
+			
+			bench = find_bench_preset(argv[++i]);
+
+			if (bench == NULL) {
+				
+				return 1;
+			}
+
+		} else if (strcmp(argv[i], "--bench-ticks") == 0 && i + 1 < argc) {
+			
+			bench_ticks = atoi(argv[++i]);
+
+		} else if (strcmp(argv[i], "--bench-json") == 0 && i + 1 < argc) {
+			
+			bench_json = argv[++i];
+
+		} else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+			
+			trace_path = argv[++i];
+
+		} else if (strcmp(argv[i], "--xsync") == 0) {
+			
+			xsync = true;
+
+		} else if (strcmp(argv[i], "--alloc-check") == 0) {
+			
+			alloc_check = true;
+
+		} else {
+			
+			printf("unknown option: %s\n", argv[i]);
+			return 1;
+		}
+	}
 	
+	//a replay brings its own settings, a recording saves the ones given on the command line
+	if (play_path != NULL) {
+		
+		if (replay_open(&replay, play_path) != 0) {
+			
+			return 1;
+		}
+
+		seed = replay.header.seed;
+		wave_size = replay.header.wave_size;
+		asteroid_capacity = replay.header.asteroid_capacity;
+		asteroid_budget_mb = replay.header.asteroid_budget_mb;
+		max_bullets = replay.header.max_bullets;
+
+	} else if (record_path != NULL) {
+		
+		ReplayHeader header = {seed, wave_size, asteroid_capacity, asteroid_budget_mb, max_bullets};
+
+		if (replay_record(&replay, record_path, &header) != 0) {
+			
+			return 1;
+		}
+	}
+
+	if (play_fast) {
+		
+		max_fps = 0;
+	}
+
+	if (bench != NULL) {
+		
+		wave_size = bench->asteroids;
+		asteroid_capacity = bench->capacity;
+		asteroid_budget_mb = 0;
+		max_bullets = BENCH_MAX_BULLETS;
+		bench_ticks = (bench_ticks < 1) ? 1 : bench_ticks;
+	}
+
 	load_ply(&title, "title.ply");
 	title.scale_s = 500.0f;
 
 	init_ship(&ship);
 	init_ship(&lives);
-	init_asteroids(asteroids);
-	init_bullets(bullets);
+
+	arena_init(&session_arena, SESSION_ARENA_BLOCK, (size_t) asteroid_budget_mb << 20);
+	arena_init(&frame_arena, FRAME_ARENA_BLOCK, 0);
+
+	if (jobs_init(&jobs, threads) != 0 || asteroid_field_alloc(&asteroids, &session_arena, asteroid_capacity, wave_size) != 0) {
+		
+		return 1;
+	}
+
+	bullet_pool_alloc(&bullets, &session_arena, max_bullets);
+
+	//one trace ring for every thread the job system ended up with
+	if (trace_path != NULL && trace_init(trace_path, jobs.thread_count) != 0) {
+		
+		return 1;
+	}
+
+	if (new_game(&ship, &asteroids, &bullets, seed) != 0) {
+		
+		replay_close(&replay);
+		free_game(&jobs, &ship, &asteroids, &session_arena);
+		trace_shutdown();
+		model3D_free(&title);
+		model3D_free(&lives.model);
+
+		return 1;
+	}
+
+	//the bench never opens a window
+	if (bench != NULL) {
+		
+		exit_code = bench_sim(&jobs, &ship, &asteroids, &bullets, bench, bench_ticks, bench_json);
+		free_game(&jobs, &ship, &asteroids, &session_arena);
+		trace_shutdown();
+		model3D_free(&title);
+		model3D_free(&lives.model);
+
+		return exit_code;
+	}
+
 	load_font(&fontmap, "fontmap.png", f_map, 8, 16);
 	lives.model.scale_s = 15.0f;
 
@@ -86,83 +401,196 @@ int main () {
 	int running = 1;
 	XEvent ev;
 	
-	float hw = (float) app.width / 2.0f;	//half the window width
-	float hh = (float) app.height / 2.0f;	//half the window height
-	float angle = 0.0f;
 	double last_time = get_time_seconds();
-	double target_time = 1.0 / 60.0;
-	int x = PBUF_WIDTH / 2;
-	int y = PBUF_HEIGHT / 2;
+	double target_time = (max_fps > 0) ? 1.0 / max_fps : 0.0;
+	double accumulator = 0.0;
+
+	//static strings are rendered once up front and blitted every frame
+	TextRun *play = text_run_get(&fontmap, "Press Space to Play");
+	TextRun *lives_text = text_run_get(&fontmap, "Lives");
+	TextRun *over = text_run_get(&fontmap, "GAME OVER");
+	TextRun *win = text_run_get(&fontmap, "YOU WIN !!!");
+	TextRun *play_again = text_run_get(&fontmap, "Press SPACE to play again!");
+
+	if (play == NULL || lives_text == NULL || over == NULL || win == NULL || play_again == NULL) {
+		
+		puts("could not render the static text");
+		return 1;
+	}
+
+	//the overlay text changes every frame, its runs are sized now so showing it never allocates
+	if (prof_reserve_overlay(&fontmap) != 0 || xstats_reserve_overlay(&fontmap) != 0) {
+		
+		puts("could not allocate the profiler overlay");
+		return 1;
+	}
+
+	//a replay is driven by its ticks rather than by input, it never waits on the server
+	bool idle_wait = play_path == NULL;
+	GameState drawn_state = current_state;
+
+	app.redraw = true;
 	
 	while (running) {
 
+		TRACE_SCOPE("frame");
+
+		//nothing allocated last frame outlives it
+		arena_reset(&frame_arena);
+
+		//a game in progress should run on what it allocated up front, from here on any allocation aborts
+		if (alloc_check && current_state == MAIN_GAME) {
+			
+			mem_guard(true);
+		}
+
+		prof_frame_begin();
+		xstats_frame_begin(app.d);
+
 		double frame_start = get_time_seconds();
-        	float delta_time = (float)(frame_start - last_time);	
+		accumulator += frame_start - last_time;
 		last_time = frame_start;
+
+		//after a long stall drop the time we can't catch up on rather than spiral
+		if (accumulator > MAX_CATCHUP_TICKS * SIM_DT) {
+			
+			accumulator = MAX_CATCHUP_TICKS * SIM_DT;
+		}
 		
 		//process key and mouse events
-		process_events(&app, &ship, &lives, asteroids, bullets, &ev, &running);
+		double stage_start = prof_now();
+
+		//a failed resize leaves no frame buffers, stop before anything is drawn
+		if (process_events(&app, &input, &ev, &running) != 0) {
+			
+			exit_code = 1;
+			break;
+		}
+
+		prof_end(PROF_EVENTS, stage_start);
+		stage_start = prof_now();
+
+		//advance the simulation in fixed ticks so game speed does not depend on frame rate
+		//a fast replay ignores the clock and runs a batch of ticks every frame
+		int ticks = (int) (accumulator / SIM_DT);
+
+		accumulator -= ticks * SIM_DT;
+
+		if (play_path != NULL && play_fast) {
+			
+			ticks = REPLAY_FAST_TICKS;
+			accumulator = 0.0;
+		}
+
+		for (int t = 0; t < ticks && running; t++) {
+			
+			InputFrame in = input;
+			uint32_t expected = 0;
+
+			input.pressed = 0;
+
+			if (play_path != NULL && !replay_read(&replay, &in, &expected)) {
+				
+				printf("replay finished after %u ticks, every tick matched\n", replay.tick);
+				running = 0;
+				break;
+			}
+
+			//a restart that could not set up the next game leaves nothing to play
+			if (simulate_tick(&jobs, &ship, &asteroids, &bullets, in) != 0) {
+				
+				running = 0;
+				exit_code = 1;
+				break;
+			}
+
+			if (play_path != NULL || record_path != NULL) {
+				
+				uint32_t hash = state_hash(&ship, &asteroids, &bullets);
+
+				if (play_path == NULL) {
+					
+					replay_write(&replay, in, hash);
+
+				} else if (hash != expected) {
+					
+					printf("replay diverged at tick %u: state hash %08x, recorded %08x\n", replay.tick, hash, expected);
+					running = 0;
+					exit_code = 1;
+				}
+			}
+		}
+
+		prof_end(PROF_SIMULATE, stage_start);
+
+		//The game over and win screens look the same from one frame to the next. Once one is on the window
+		//there is nothing to draw until the state changes or the window is exposed or resized, so sleep until
+		//input arrives. A press that is waiting for its tick only sleeps until the next tick is due
+		bool animated = current_state == TITLE_SCREEN || current_state == MAIN_GAME || prof_overlay_visible();
+
+		if (idle_wait && !animated && !app.redraw && current_state == drawn_state) {
+			
+			prof_frame_skip();
+			wait_for_event(&app, (input.pressed != 0) ? SIM_DT : IDLE_WAKE);
+			continue;
+		}
+
+		app.redraw = false;
+		drawn_state = current_state;
+
+		//how far we are between the last tick and the next one
+		float alpha = (float) (accumulator / SIM_DT);
+
+		//meshes are centred on the window and text on the pixel buffer, either can change size with the window
+		float hw = (float) app.width / 2.0f;	//half the window width
+		float hh = (float) app.height / 2.0f;	//half the window height
+		int x = app.pixel_buffer_w / 2;
+		int y = app.pixel_buffer_h / 2;
 		
 		//drawing operations
-		clear_screen(&app, 0x000000);
+		clear_screen(&app);
+
+		int overlay_end = prof_draw_overlay(&app, &fontmap, 4, 20);
+
+		if (overlay_end > 0) {
+			
+			xstats_draw_overlay(&app, &fontmap, 4, overlay_end);
+		}
 
 		switch (current_state) {
 
 			case TITLE_SCREEN:
 				
 				//copy pixel_buffer to the xlib pixmap for display
-				char *play = "Press Space to Play";
-				int len = (strlen(play) * 8) / 2;
-
-				draw_string(&app, &fontmap, play, x - len, PBUF_HEIGHT - 100);
+				draw_text_run(&app, play, x - play->sprite.width / 2, app.pixel_buffer_h - 100);
 				update_ximage(&app);
 				
-				update_asteroids(asteroids);
-				draw_asteroids(&app, asteroids, hw, hh);
-				
-				project(&title, hw, hh);
-				draw_mesh(&app, &title);
+				draw_asteroids(&app, &frame_arena, &asteroids, hw, hh, alpha);
+				draw_model(&app, &frame_arena, &title, hw, hh, 1.0f);
 				break;
 			
 			case MAIN_GAME:
-		
-				//update ship and asteroids position, velocity etc
-				check_collisions(&ship, asteroids, bullets);
-				update_ship(&ship);
-				update_asteroids(asteroids);
-				update_bullets(bullets, delta_time);
 				
-				draw_string(&app, &fontmap, "Lives", 0, 0);
+				draw_text_run(&app, lives_text, 0, 0);
 				update_ximage(&app);
 				
-				project(&ship.model, hw, hh);
-				draw_mesh(&app, &ship.model);
-				draw_lives(&app, &lives, ship.lives, hw, hh);
-				draw_asteroids(&app, asteroids, hw, hh);
-				draw_bullets(&app, bullets, hw, hh);
+				draw_model(&app, &frame_arena, &ship.model, hw, hh, alpha);
+				draw_lives(&app, &frame_arena, &lives, ship.lives, hw, hh);
+				draw_asteroids(&app, &frame_arena, &asteroids, hw, hh, alpha);
+				draw_bullets(&app, &bullets, hw, hh, alpha);
 				break;
 
 			case GAME_OVER:
 				
-				char *over = "GAME OVER";
-				char *replay = "Press SPACE to play again!";
-				int leng = (strlen(over) * 8) / 2;
-				int len2 = (strlen(replay) * 8) / 2;
-
-				draw_string(&app, &fontmap, over, x - leng, y);
-				draw_string(&app, &fontmap, replay, x - len2, PBUF_HEIGHT - 100);
+				draw_text_run(&app, over, x - over->sprite.width / 2, y);
+				draw_text_run(&app, play_again, x - play_again->sprite.width / 2, app.pixel_buffer_h - 100);
 				update_ximage(&app);
 				break;
 
 			case WIN_SCREEN:
 				
-				char *win = "YOU WIN !!!";
-				char *replay2 = "Press SPACE to play again!";
-				int len3 = (strlen(win) * 8) / 2;
-				int len4 = (strlen(replay2) * 8) / 2;
-
-				draw_string(&app, &fontmap, win, x - len3, y);
-				draw_string(&app, &fontmap, replay2, x - len4, PBUF_HEIGHT - 100);
+				draw_text_run(&app, win, x - win->sprite.width / 2, y);
+				draw_text_run(&app, play_again, x - play_again->sprite.width / 2, app.pixel_buffer_h - 100);
 				update_ximage(&app);
 				break;
 
@@ -173,6 +601,14 @@ int main () {
 		
 		flip_buffer(&app);
 
+		//wait for the server to finish the frame so its time shows up apart from the time spent in the client
+		if (xsync) {
+			
+			stage_start = prof_now();
+			x_sync(app.d);
+			prof_end(PROF_XSYNC, stage_start);
+		}
+
 		//Calculate how much time we spent doing work
 		double frame_end = get_time_seconds();
 		double time_spent_working = frame_end - frame_start;
@@ -185,28 +621,329 @@ int main () {
 	}	
 
 	//free resources use by program		
+	mem_guard(false);
 	close_x(&app);
-	model3D_free(&ship.model);
+	prof_print_summary();
+	xstats_print_summary();
+
+	if (stress) {
+		
+		printf("asteroids: peak live %d, capacity %d, grew %d times, %d spawns dropped\n", asteroids.peak_live, asteroids.capacity, asteroids.grow_count, asteroids.dropped);
+		printf("session arena: %zu bytes reserved, %zu bytes peak use, %zu bytes budget\n", session_arena.reserved, session_arena.peak, session_arena.budget);
+	}
+
+	replay_close(&replay);
+	free_game(&jobs, &ship, &asteroids, &session_arena);
+	trace_shutdown();
+	model3D_free(&title);
+	model3D_free(&lives.model);
+	arena_free(&frame_arena);
+	text_run_cache_free();
+	prof_free_overlay();
+	xstats_free_overlay();
+	font_free(&fontmap);
+
+	//anything still live here was never freed
+	if (alloc_check) {
+		
+		mem_print_summary();
+	}
 	
-	return 0;
+	return exit_code;
+}
+
+//free everything the simulation owns, the asteroids and bullets of the last game go with the session arena
+void free_game(JobSystem *jobs, Ship *ship, AsteroidField *asteroids, Arena *arena) {
+
+	jobs_shutdown(jobs);
+	asteroid_field_free(asteroids);
+	arena_free(arena);
+	model3D_free(&ship->model);
+}
+
+const BenchPreset *find_bench_preset(const char *name) {
+
+	for (int i = 0; i < (int) (sizeof(bench_presets) / sizeof(bench_presets[0])); i++) {
+		
+		if (strcmp(bench_presets[i].name, name) == 0) {
+			
+			return &bench_presets[i];
+		}
+	}
+
+	printf("unknown bench preset: %s, choose from", name);
+
+	for (int i = 0; i < (int) (sizeof(bench_presets) / sizeof(bench_presets[0])); i++) {
+		
+		printf(" %s", bench_presets[i].name);
+	}
+
+	puts("");
+
+	return NULL;
 }
 
-int check_win(Asteroid *asteroids) {
+//input the autopilot gives on a tick
+static InputFrame autopilot_input(const BenchPreset *preset, int tick) {
+
+	InputFrame in = {0};
+
+	if (preset->autopilot == AUTOPILOT_SPIN) {
+		
+		in.held = INPUT_LEFT;
+
+	} else if (preset->autopilot == AUTOPILOT_WEAVE) {
+		
+		in.held = ((tick / 60) % 2) ? INPUT_RIGHT : INPUT_LEFT | INPUT_THRUST;
+	}
+
+	if (preset->fire_every > 0 && tick % preset->fire_every == 0) {
+		
+		in.pressed = INPUT_FIRE;
+	}
+
+	return in;
+}
+
+static int compare_double(const void *a, const void *b) {
+
+	double x = *(const double *) a;
+	double y = *(const double *) b;
+
+	return (x > y) - (x < y);
+}
+
+//value at fraction p of a sorted array
+static double percentile(double *sorted, int n, double p) {
+
+	int i = (int) (p * (n - 1) + 0.5);
+
+	return sorted[i];
+}
+
+//run the simulation without X for ticks ticks on a preset scene, report ticks per second and how long each stage took
+//the ship never runs out of lives and a cleared wave is replaced outside the timed part, so every tick is a game tick
+int bench_sim(JobSystem *jobs, Ship *ship, AsteroidField *asteroids, BulletPool *bullets, const BenchPreset *preset, int ticks, const char *json_path) {
+
+	double *samples = mem_alloc(MEM_OTHER, (size_t) (STAGE_COUNT + 1) * ticks * sizeof(double));
+	double times[STAGE_COUNT];
+	double elapsed = 0.0;
+	int waves = 1;
+
+	if (samples == NULL) {
+		
+		puts("Could not allocate memory for bench samples");
+		return 1;
+	}
+
+	stage_seconds = times;
+	current_state = MAIN_GAME;
+
+	for (int t = 0; t < ticks; t++) {
+		
+		InputFrame in = autopilot_input(preset, t);
+		double start = get_time_seconds();
 
-	for (int i = 0; i < NUM_ASTEROIDS; i ++) {
+		if (simulate_tick(jobs, ship, asteroids, bullets, in) != 0) {
+			
+			mem_free(samples);
+			return 1;
+		}
+
+		double tick_time = get_time_seconds() - start;
+
+		elapsed += tick_time;
+		samples[STAGE_COUNT * ticks + t] = tick_time;
+
+		for (int s = 0; s < STAGE_COUNT; s++) {
+			
+			samples[s * ticks + t] = times[s];
+		}
 
-		if (asteroids[i].alive == true) {
+		if (current_state == WIN_SCREEN) {
 			
-			return 0;
+			if (new_game(ship, asteroids, bullets, asteroids->seed + 1) != 0) {
+				
+				mem_free(samples);
+				return 1;
+			}
+
+			waves++;
 		}
+
+		ship->lives = 3;
+		current_state = MAIN_GAME;
+	}
+
+	stage_seconds = NULL;
+
+	FILE *json = NULL;
+
+	if (json_path != NULL) {
+		
+		json = fopen(json_path, "w");
+
+		if (json == NULL) {
+			
+			printf("Could not open bench result file: %s\n", json_path);
+		}
+	}
+
+	printf("bench-sim %s: %d ticks, %d threads, %d waves, %d asteroids live at the end (peak %d)\n", preset->name, ticks, jobs->thread_count, waves, asteroids->pool.live_count, asteroids->peak_live);
+	printf("%.1f ticks/s\n", ticks / elapsed);
+	printf("%-18s %10s %10s %10s %10s %10s\n", "stage (us)", "mean", "p50", "p90", "p99", "max");
+
+	if (json != NULL) {
+		
+		fprintf(json, "{\n  \"preset\": \"%s\",\n  \"asteroids\": %d,\n  \"capacity\": %d,\n  \"fire_every\": %d,\n  \"ticks\": %d,\n  \"threads\": %d,\n", preset->name, preset->asteroids, preset->capacity, preset->fire_every, ticks, jobs->thread_count);
+		fprintf(json, "  \"waves\": %d,\n  \"peak_live\": %d,\n  \"ticks_per_second\": %.3f,\n  \"stages\": {\n", waves, asteroids->peak_live, ticks / elapsed);
+	}
+
+	//the whole tick goes last as its own row
+	for (int s = 0; s <= STAGE_COUNT; s++) {
+		
+		double *stage = &samples[s * ticks];
+		const char *name = (s < STAGE_COUNT) ? stage_names[s] : "tick";
+		double sum = 0.0;
+
+		for (int t = 0; t < ticks; t++) {
+			
+			sum += stage[t];
+		}
+
+		qsort(stage, ticks, sizeof(double), compare_double);
+
+		double mean = sum / ticks * 1e6;
+		double p50 = percentile(stage, ticks, 0.50) * 1e6;
+		double p90 = percentile(stage, ticks, 0.90) * 1e6;
+		double p99 = percentile(stage, ticks, 0.99) * 1e6;
+		double max = stage[ticks - 1] * 1e6;
+
+		printf("%-18s %10.1f %10.1f %10.1f %10.1f %10.1f\n", name, mean, p50, p90, p99, max);
+
+		if (json != NULL) {
+			
+			fprintf(json, "    \"%s\": {\"mean_us\": %.3f, \"p50_us\": %.3f, \"p90_us\": %.3f, \"p99_us\": %.3f, \"max_us\": %.3f}%s\n", name, mean, p50, p90, p99, max, (s < STAGE_COUNT) ? "," : "");
+		}
+	}
+
+	if (json != NULL) {
+		
+		fprintf(json, "  }\n}\n");
+		fclose(json);
 	}
 
-	return 1;
+	mem_free(samples);
+
+	return 0;
+}
+
+//advance the game by one fixed tick of SIM_DT seconds using the input in
+//returns 1 if the fire button restarted the game and the new game could not be set up
+int simulate_tick(JobSystem *jobs, Ship *ship, AsteroidField *asteroids, BulletPool *bullets, InputFrame in) {
+
+	TRACE_SCOPE("simulate_tick");
+	JobCounter done = {0};
+
+	//remember where everything was so rendering can interpolate towards the new state
+	//asteroids save theirs in the same pass that moves them
+	save_state(&ship->model);
+
+	for (int k = 0; k < bullets->pool.live_count; k++) {
+		
+		save_state(&bullets->items[bullets->pool.live[k]].model);
+	}
+
+	if ((in.pressed & INPUT_FIRE) && press_fire(ship, asteroids, bullets) != 0) {
+		
+		return 1;
+	}
+
+	switch (current_state) {
+
+		case TITLE_SCREEN:
+			
+			update_asteroids(jobs, asteroids);
+			break;
+
+		case MAIN_GAME:
+			
+			//update ship and asteroids position, velocity etc
+			apply_input(ship, in);
+			RUN_STAGE(STAGE_COLLISIONS, check_collisions(jobs, ship, asteroids, bullets));
+			RUN_STAGE(STAGE_SHIP, update_ship(ship));
+			RUN_STAGE(STAGE_ASTEROIDS, update_asteroids(jobs, asteroids));
+			RUN_STAGE(STAGE_BULLETS, update_bullets(bullets, SIM_DT));
+			break;
+
+		default:
+			
+			jobs_parallel_for(jobs, asteroid_save_job, asteroids, asteroids->count, ASTEROID_JOB_GRAIN, &done);
+			jobs_wait(jobs, &done);
+			break;
+	}
+
+	return 0;
+}
+
+int check_win(AsteroidField *asteroids) {
+
+	return asteroids->pool.live_count == 0;
+}
+
+static uint32_t hash_bytes(uint32_t h, const void *data, size_t size) {
+
+	const uint8_t *p = data;
+
+	for (size_t i = 0; i < size; i++) {
+		
+		h = (h ^ p[i]) * 16777619u;
+	}
+
+	return h;
+}
+
+//FNV-1a hash of everything the simulation carries from one tick to the next, used to catch a replay diverging
+uint32_t state_hash(Ship *ship, AsteroidField *asteroids, BulletPool *bullets) {
+
+	uint32_t h = 2166136261u;
+
+	h = hash_bytes(h, &current_state, sizeof(current_state));
+	h = hash_bytes(h, &ship->lives, sizeof(ship->lives));
+	h = hash_bytes(h, &ship->model.position, sizeof(Vector3));
+	h = hash_bytes(h, &ship->model.velocity, sizeof(Vector3));
+	h = hash_bytes(h, &ship->model.rotation, sizeof(Vector3));
+	h = hash_bytes(h, &asteroids->rng, sizeof(Rng));
+	h = hash_bytes(h, &asteroids->pool.live_count, sizeof(int));
+
+	for (int k = 0; k < asteroids->pool.live_count; k++) {
+		
+		int i = asteroids->pool.live[k];
+
+		h = hash_bytes(h, &i, sizeof(int));
+		h = hash_bytes(h, &asteroids->pos_x[i], sizeof(float));
+		h = hash_bytes(h, &asteroids->pos_y[i], sizeof(float));
+		h = hash_bytes(h, &asteroids->rot_z[i], sizeof(float));
+	}
+
+	for (int k = 0; k < bullets->pool.live_count; k++) {
+		
+		Bullet *b = &bullets->items[bullets->pool.live[k]];
+
+		h = hash_bytes(h, &b->model.position, sizeof(Vector3));
+		h = hash_bytes(h, &b->time_alive, sizeof(float));
+	}
+
+	return h;
 }
 
-void process_events(App *app, Ship *ship, Ship *lives, Asteroid *asteroids, Bullet *bullets, XEvent *ev, int *running) {
+//returns 1 if the window was resized and the frame buffers could not be made again, there is nothing to draw into
+int process_events(App *app, InputFrame *input, XEvent *ev, int *running) {
 	
-	while (XPending(app->d)) {
+	int width = app->width;
+	int height = app->height;
+
+	while (x_pending(app->d)) {
 	
 		XNextEvent(app->d, ev);
 		
@@ -219,11 +956,17 @@ void process_events(App *app, Ship *ship, Ship *lives, Asteroid *asteroids, Bull
 			}
 		}
 
-		// resize event
+		// resize event, a drag sends a burst of them so only the last size is acted on
 		if (ev->type == ConfigureNotify) {
 		
-			app->width = ev->xconfigure.width;
-			app->height = ev->xconfigure.height;
+			width = ev->xconfigure.width;
+			height = ev->xconfigure.height;
+		}
+
+		//part of the window has to be drawn again, a static screen won't do it by itself
+		if (ev->type == Expose) {
+			
+			app->redraw = true;
 		}
 
 		// Only do key logic if it's actually a key event
@@ -252,57 +995,102 @@ void process_events(App *app, Ship *ship, Ship *lives, Asteroid *asteroids, Bull
 				
 				toggle_fullscreen(app);
 			}
+
+			if (ev->type == KeyPress && k == XK_p) {
+				
+				prof_toggle_overlay();
+				app->redraw = true;
+			}
+
+			//write out what the trace rings hold so far without stopping the game
+			if (ev->type == KeyPress && k == XK_t) {
+				
+				trace_flush();
+			}
 			
+			//kept until the next tick takes it so a press between ticks isn't lost
 			if (ev->type == KeyPress && k == XK_space) {
 			
-				if (current_state == TITLE_SCREEN) {
+				input->pressed |= INPUT_FIRE;
+			}
+		}
+	}
 
-					current_state = MAIN_GAME;
+	//the frame buffers are made again at the new size, the one place a game in progress allocates, so the
+	//allocation guard is lifted until the top of the next frame
+	if (width != app->width || height != app->height) {
+		
+		mem_guard(false);
 
-				} else if (current_state == GAME_OVER || current_state == WIN_SCREEN) {
-					
-					current_state = TITLE_SCREEN;
-					init_ship(ship);
-					init_ship(lives);
-					init_asteroids(asteroids);
-					init_bullets(bullets);
-					lives->model.scale_s = 15.0f;
-
-				} else if (current_state == MAIN_GAME) {
-				
-					for (int i = 0; i < NUM_BULLETS; i++) {
-						
-						if (bullets[i].alive == false) {
-							
-							Vector3 b_vel = (Vector3) {10.0f, -10.0f, 0.0f};
-							Vector3 b_offset = v3_multi_s(ship->model.direction, ship->model.scale_s);
-
-							bullets[i].alive = true;
-							//bullets[i].time_alive = 0;
-							bullets[i].model.position = v3_add(ship->model.position, b_offset);
-							bullets[i].model.position.y = -bullets[i].model.position.y;
-							bullets[i].model.velocity = v3_multi(ship->model.direction, b_vel);
-							break;
-						}
-					}
-				}
-			}
+		if (resize_x(app, width, height) != 0) {
+			
+			*running = 0;
+			return 1;
 		}
+
+		app->redraw = true;
 	}
+
+	//map the held keys onto the buttons the simulation knows about
+	input->held = 0;
+	input->held |= (keys[XK_a] || keys[XK_Left]) ? INPUT_LEFT : 0;
+	input->held |= (keys[XK_d] || keys[XK_Right]) ? INPUT_RIGHT : 0;
+	input->held |= (keys[XK_w] || keys[XK_Up]) ? INPUT_THRUST : 0;
+
+	return 0;
+}
+
+//the fire button starts a game from the title screen, restarts once a game is over and shoots during play
+//returns 1 if a restart could not set up the new game
+int press_fire(Ship *ship, AsteroidField *asteroids, BulletPool *bullets) {
+
+	if (current_state == TITLE_SCREEN) {
+
+		current_state = MAIN_GAME;
+
+	} else if (current_state == GAME_OVER || current_state == WIN_SCREEN) {
+		
+		current_state = TITLE_SCREEN;
+		return new_game(ship, asteroids, bullets, asteroids->seed + 1);
+
+	} else if (current_state == MAIN_GAME) {
 	
+		int i = pool_alloc(&bullets->pool);
+
+		if (i >= 0) {
+			
+			Bullet *b = &bullets->items[i];
+			Vector3 b_vel = (Vector3) {10.0f, -10.0f, 0.0f};
+			Vector3 b_offset = v3_multi_s(ship->model.direction, ship->model.scale_s);
+
+			b->time_alive = 0;
+			b->model.position = v3_add(ship->model.position, b_offset);
+			b->model.position.y = -b->model.position.y;
+			b->model.prev_position = b->model.position;
+			b->model.velocity = v3_multi(ship->model.direction, b_vel);
+		}
+	}
+
+	return 0;
+}
+
+//apply the held buttons to the ship, called once per simulation tick
+void apply_input(Ship *ship, InputFrame in) {
+
 	//rotate ship to the left
-	if (keys[XK_a] || keys[XK_Left]) {
+	if (in.held & INPUT_LEFT) {
 		
 		setModelDirection(&ship->model, .04f);
 	}
 	
 	//rotate ship to the right
-	if (keys[XK_d] || keys[XK_Right]) {
+	if (in.held & INPUT_RIGHT) {
 		
 		setModelDirection(&ship->model, -.04f);
 	}
 
-	if (keys[XK_w] || keys[XK_Up]) {
+	if (in.held & INPUT_THRUST) {
+
 
 		// direction is a unit vector, so we scale it by our 'thrust' amount
 		ship->model.acceleration = v3_multi_s(ship->model.direction, SHIP_ACCEL);
@@ -323,92 +1111,241 @@ int circles_touching(Vector3 p1, float r1, Vector3 p2, float r2) {
 	return (d.x * d.x + d.y * d.y) < (limit * limit);
 }
 
-void spawn_asteroids(Asteroid *asteroids, Vector3 pos, asteroid_size_t a_size) {
+//spawn the 3 fragments of a split asteroid, fragments that don't fit in the pool are dropped
+void spawn_asteroids(AsteroidField *asteroids, Vector3 pos, asteroid_size_t a_size) {
 
-	int count = 0;
-
-	for(int i = 0; i < NUM_ASTEROIDS; i++) {
-		
-		if (a_size == AST_MEDIUM && asteroids[i].size == a_size && asteroids[i].alive == false) {
-			
-			asteroids[i].alive = true;
-			asteroids[i].model.position = pos;
-			count++;
-		}
+	for(int i = 0; i < 3; i++) {
 		
-		if (a_size == AST_SMALL && asteroids[i].size == a_size && asteroids[i].alive == false) {
-			
-			asteroids[i].alive = true;
-			asteroids[i].model.position = pos;
-			count++;
-		}
-
-		if (count == 3) {
+		if (add_asteroid(asteroids, &asteroids->rng, pos.x, pos.y, a_size) < 0) {
 
 			break;
 		}
 	}
 }
 
-void check_collisions(Ship *ship, Asteroid *asteroids, Bullet *bullets) {
+//does the segment from p to p + d pass within r of the origin
+static int segment_hits_circle(float px, float py, float dx, float dy, float r) {
 
-	int hw = SCREEN_WIDTH / 2;
-	int hh = SCREEN_HEIGHT / 2;
-	
-	for(int i = 0; i < NUM_ASTEROIDS; i++) {
+	float len2 = dx * dx + dy * dy;
+	float t = (len2 > 0.0f) ? -(px * dx + py * dy) / len2 : 0.0f;
+
+	t = (t < 0.0f) ? 0.0f : (t > 1.0f) ? 1.0f : t;
+
+	float cx = px + dx * t;
+	float cy = py + dy * t;
+
+	return (cx * cx + cy * cy) < (r * r);
+}
 
-		Vector3 ship_pos = ship->model.position;
-		float ship_r = ship->model.scale_s;
-		Vector3 ast_pos = asteroids[i].model.position;
-		float ast_r = asteroids[i].model.scale_s;
+//first point along the segment from p to p + d that is inside the outline of a mesh's first face
+//everything is in the mesh's local space, returns how far along the segment (0 to 1) or -1 for a miss
+static float segment_hits_outline(float px, float py, float dx, float dy, Model3D *mesh) {
 
-		int r = circles_touching(ship_pos, ship_r, ast_pos , ast_r);
+	int n = mesh->facev[0];
+	int inside = 0;
+	float first = -1.0f;
 
-		//ship collision
-		if (r && asteroids[i].alive) { 
+	for (int k = 0, j = n - 1; k < n; j = k++) {
+		
+		Vector3 a = mesh->local_verts[mesh->meshf[j]];
+		Vector3 b = mesh->local_verts[mesh->meshf[k]];
+
+		//even-odd test of the start point
+		if ((a.y > py) != (b.y > py) && px < a.x + (py - a.y) * (b.x - a.x) / (b.y - a.y)) {
+			
+			inside = !inside;
+		}
+
+		//segment against edge a->b
+		float ex = b.x - a.x;
+		float ey = b.y - a.y;
+		float denom = dx * ey - dy * ex;
+
+		if (denom == 0.0f) {
 			
-			ship->lives--;
-			ship->model.position = (Vector3) {0};
-			ship->model.velocity = (Vector3) {0};
 			continue;
 		}
 
-		for (int j = 0; j < NUM_BULLETS; j++) {
-		
-			Vector3 b_pos = v3_multi(bullets[j].model.position, (Vector3) {1.0f, -1.0f, 1.0f});
-			r = circles_touching(b_pos, 0, ast_pos , ast_r);
+		float wx = a.x - px;
+		float wy = a.y - py;
+		float t = (wx * ey - wy * ex) / denom;
+		float u = (wx * dy - wy * dx) / denom;
+
+		if (t >= 0.0f && t <= 1.0f && u >= 0.0f && u <= 1.0f && (first < 0.0f || t < first)) {
 			
-			//bullet collision
-			if (r && asteroids[i].alive && bullets[j].alive) { 
-				
-				bullets[j] = (Bullet) {0};
+			first = t;
+		}
+	}
 
-				if (asteroids[i].size == AST_LARGE) {
-					
-					asteroids[i].alive = false;
-					spawn_asteroids(asteroids, ast_pos, AST_MEDIUM);
-					continue;		
+	return inside ? 0.0f : first;
+}
+
+//sweep one bullet through the grid and return the first asteroid along its path, or -1
+//the grid cells are walked directly rather than through grid_query so bullets can be swept on many threads at once
+static int sweep_bullet(AsteroidField *asteroids, Bullet *bullet) {
+
+	Grid *grid = &asteroids->grid;
+	Vector3 b_pos = v3_multi(bullet->model.position, (Vector3) {1.0f, -1.0f, 1.0f});
+	Vector3 b_vel = v3_multi(bullet->model.velocity, (Vector3) {1.0f, -1.0f, 1.0f});
+	float reach = sqrtf(b_vel.x * b_vel.x + b_vel.y * b_vel.y) / 2.0f;
+	GridBox box = grid_box(grid, b_pos.x + b_vel.x / 2.0f, b_pos.y + b_vel.y / 2.0f, reach + MAX_ASTEROID_RADIUS * asteroids->outline_radius);
+	int hit = -1;
+	float hit_t = 2.0f;
+
+	for (int cy = box.cy0; cy <= box.cy1; cy++) {
+		
+		int row = grid_wrap(cy, grid->rows) * grid->cols;
+
+		for (int cx = box.cx0; cx <= box.cx1; cx++) {
+			
+			for (int i = grid->head[row + grid_wrap(cx, grid->cols)]; i >= 0; i = grid->next[i]) {
 				
-				} else if (asteroids[i].size == AST_MEDIUM) {
+				float r = asteroids->scale[i];
+				float px = b_pos.x - asteroids->pos_x[i];
+				float py = b_pos.y - asteroids->pos_y[i];
+				float dx = b_vel.x - asteroids->vel_x[i];
+				float dy = b_vel.y - asteroids->vel_y[i];
+
+				//broadphase, swept bullet against the bounding circle
+				if (!segment_hits_circle(px, py, dx, dy, r * asteroids->outline_radius)) {
 					
-					asteroids[i].alive = false;
-					spawn_asteroids(asteroids, ast_pos, AST_SMALL);
 					continue;
-				
-				}else {
+				}
+
+				//narrowphase, turn the sweep into the mesh's unrotated unit space rather than transforming every vertex
+				float c, sn;
+
+				sim_sincos(asteroids->rot_z[i], &sn, &c);
+				float t = segment_hits_outline((c * px + sn * py) / r, (c * py - sn * px) / r, (c * dx + sn * dy) / r, (c * dy - sn * dx) / r, &asteroids->mesh);
+
+				//a sweep can cross more than one asteroid, the first one along it takes the bullet
+				//ties go to the lowest slot so the result doesn't depend on the order of the cell lists
+				if (t >= 0.0f && (t < hit_t || (t == hit_t && i < hit))) {
 					
-					asteroids[i].alive = false;					
+					hit = i;
+					hit_t = t;
 				}
 			}
 		}
 	}
+
+	return hit;
 }
 
-float random_float(float min, float max) {
-	
-	float scale = (float)rand() / (float)RAND_MAX; /* [0, 1.0] */
- 
-	return min + scale * (max - min);      /* [min, max] */
+//what the collision jobs share, every job only writes the entries of its own range
+typedef struct {
+
+	AsteroidField *asteroids;
+	BulletPool *bullets;
+} CollisionJob;
+
+//work out which cell each live asteroid in the range belongs in, the grid itself is relinked afterwards on one thread
+static void asteroid_cell_job(void *data, int begin, int end) {
+
+	TRACE_SCOPE("asteroid_cell_job");
+	AsteroidField *asteroids = data;
+
+	for (int k = begin; k < end; k++) {
+		
+		int i = asteroids->pool.live[k];
+
+		asteroids->next_cell[i] = grid_cell_of(&asteroids->grid, asteroids->pos_x[i], asteroids->pos_y[i]);
+	}
+}
+
+//find what each live bullet in the range hits, nothing is removed until every bullet has been swept
+static void bullet_sweep_job(void *data, int begin, int end) {
+
+	TRACE_SCOPE("bullet_sweep_job");
+	CollisionJob *job = data;
+	BulletPool *bullets = job->bullets;
+
+	for (int m = begin; m < end; m++) {
+		
+		int j = bullets->pool.live[m];
+
+		bullets->hit[j] = sweep_bullet(job->asteroids, &bullets->items[j]);
+	}
+}
+
+void check_collisions(JobSystem *jobs, Ship *ship, AsteroidField *asteroids, BulletPool *bullets) {
+
+	TRACE_SCOPE("check_collisions");
+	Grid *grid = &asteroids->grid;
+	CollisionJob job = {asteroids, bullets};
+	JobCounter done = {0};
+
+	//bring the broadphase up to date, cells are found in parallel and only asteroids that changed cell are relinked
+	jobs_parallel_for(jobs, asteroid_cell_job, asteroids, asteroids->pool.live_count, ASTEROID_JOB_GRAIN, &done);
+	jobs_wait(jobs, &done);
+
+	for (int k = 0; k < asteroids->pool.live_count; k++) {
+		
+		int i = asteroids->pool.live[k];
+
+		grid_move(grid, i, asteroids->next_cell[i]);
+	}
+
+	Vector3 ship_pos = ship->model.position;
+	float ship_r = ship->model.scale_s;
+	int n = grid_query(grid, ship_pos.x, ship_pos.y, ship_r + MAX_ASTEROID_RADIUS);
+
+	//ship collision, the ship is moved back to the centre so it can only be hit once per tick
+	for (int k = 0; k < n; k++) {
+		
+		int i = grid->query[k];
+		Vector3 ast_pos = (Vector3) {asteroids->pos_x[i], asteroids->pos_y[i], 0.0f};
+
+		if (circles_touching(ship_pos, ship_r, ast_pos, asteroids->scale[i])) {
+			
+			ship->lives--;
+			ship->model.position = (Vector3) {0};
+			ship->model.prev_position = (Vector3) {0};
+			ship->model.velocity = (Vector3) {0};
+			break;
+		}
+	}
+
+	//bullets are swept along the path they move this tick so fast bullets can't tunnel through small asteroids
+	//the sweep is done relative to each asteroid, which is treated as still over the tick
+	jobs_parallel_for(jobs, bullet_sweep_job, &job, bullets->pool.live_count, BULLET_JOB_GRAIN, &done);
+	jobs_wait(jobs, &done);
+
+	//apply the hits on one thread in live order so the outcome is the same whatever the thread count
+	//a bullet whose asteroid was already destroyed by another bullet this tick carries on and is swept again next tick
+	//walk the live bullets backwards so releasing one doesn't skip the bullet swapped into its place
+	int split_count = 0;
+
+	for (int m = bullets->pool.live_count - 1; m >= 0; m--) {
+		
+		int j = bullets->pool.live[m];
+		int hit = bullets->hit[j];
+
+		if (hit < 0 || !pool_is_live(&asteroids->pool, hit)) {
+			
+			continue;
+		}
+
+		//fragments are only spawned once every hit is applied, a freed slot handed straight to a fragment
+		//would still look live to a later bullet whose own asteroid was already destroyed
+		bullets->splits[split_count++] = (AsteroidSplit) {{asteroids->pos_x[hit], asteroids->pos_y[hit], 0.0f}, asteroids->size[hit]};
+		pool_release(&bullets->pool, j);
+		remove_asteroid(asteroids, hit);
+	}
+
+	for (int k = 0; k < split_count; k++) {
+		
+		AsteroidSplit *s = &bullets->splits[k];
+
+		if (s->size == AST_LARGE) {
+			
+			spawn_asteroids(asteroids, s->position, AST_MEDIUM);
+		
+		} else if (s->size == AST_MEDIUM) {
+			
+			spawn_asteroids(asteroids, s->position, AST_SMALL);
+		}
+	}
 }
 
 void update_ship(Ship *ship) {
@@ -450,151 +1387,383 @@ void update_ship(Ship *ship) {
 	}
 }
 
-void update_asteroids(Asteroid *asteroids) {
+//move, spin and wrap every asteroid, the wrap is done with selects rather than branches
+//save the state of the asteroids in the range for interpolation, then move and spin them, wrapping at the screen edges
+//ranges start on a multiple of 8 so the AVX2 blocks line up with the single threaded pass
+static void asteroid_integrate_job(void *data, int begin, int end) {
+
+	TRACE_SCOPE("asteroid_integrate_job");
+	AsteroidField *asteroids = data;
+	float hw = SCREEN_WIDTH / 2;
+	float hh = SCREEN_HEIGHT / 2;
+	int i = begin;
+
+	memcpy(&asteroids->prev_x[begin], &asteroids->pos_x[begin], (end - begin) * sizeof(float));
+	memcpy(&asteroids->prev_y[begin], &asteroids->pos_y[begin], (end - begin) * sizeof(float));
+	memcpy(&asteroids->prev_rot_z[begin], &asteroids->rot_z[begin], (end - begin) * sizeof(float));
+
+#ifdef __AVX2__
+	__m256 v_hw = _mm256_set1_ps(hw);
+	__m256 v_nhw = _mm256_set1_ps(-hw);
+	__m256 v_hh = _mm256_set1_ps(hh);
+	__m256 v_nhh = _mm256_set1_ps(-hh);
+
+	for (; i + 8 <= end; i += 8) {
 	
-	int hw = SCREEN_WIDTH / 2;
-	int hh = SCREEN_HEIGHT / 2;
+		__m256 x = _mm256_add_ps(_mm256_loadu_ps(&asteroids->pos_x[i]), _mm256_loadu_ps(&asteroids->vel_x[i]));
+		__m256 y = _mm256_add_ps(_mm256_loadu_ps(&asteroids->pos_y[i]), _mm256_loadu_ps(&asteroids->vel_y[i]));
+		__m256 r = _mm256_add_ps(_mm256_loadu_ps(&asteroids->rot_z[i]), _mm256_loadu_ps(&asteroids->spin[i]));
+
+		//off the right or top edge comes back on the left or bottom, and the other way round
+		x = _mm256_blendv_ps(x, v_nhw, _mm256_cmp_ps(x, v_hw, _CMP_GT_OQ));
+		y = _mm256_blendv_ps(y, v_nhh, _mm256_cmp_ps(y, v_hh, _CMP_GT_OQ));
+		x = _mm256_blendv_ps(x, v_hw, _mm256_cmp_ps(x, v_nhw, _CMP_LT_OQ));
+		y = _mm256_blendv_ps(y, v_hh, _mm256_cmp_ps(y, v_nhh, _CMP_LT_OQ));
+
+		_mm256_storeu_ps(&asteroids->pos_x[i], x);
+		_mm256_storeu_ps(&asteroids->pos_y[i], y);
+		_mm256_storeu_ps(&asteroids->rot_z[i], r);
+	}
+#endif
+
+	for (; i < end; i++) {
+	
+		float x = asteroids->pos_x[i] + asteroids->vel_x[i];
+		float y = asteroids->pos_y[i] + asteroids->vel_y[i];
+
+		x = (x > hw) ? -hw : x;
+		y = (y > hh) ? -hh : y;
+		x = (x < -hw) ? hw : x;
+		y = (y < -hh) ? hh : y;
+
+		asteroids->pos_x[i] = x;
+		asteroids->pos_y[i] = y;
+		asteroids->rot_z[i] += asteroids->spin[i];
+	}
+}
+
+//only save the state of the asteroids in the range, for ticks where they don't move
+static void asteroid_save_job(void *data, int begin, int end) {
+
+	TRACE_SCOPE("asteroid_save_job");
+	AsteroidField *asteroids = data;
+
+	memcpy(&asteroids->prev_x[begin], &asteroids->pos_x[begin], (end - begin) * sizeof(float));
+	memcpy(&asteroids->prev_y[begin], &asteroids->pos_y[begin], (end - begin) * sizeof(float));
+	memcpy(&asteroids->prev_rot_z[begin], &asteroids->rot_z[begin], (end - begin) * sizeof(float));
+}
+
+void update_asteroids(JobSystem *jobs, AsteroidField *asteroids) {
 	
+	TRACE_SCOPE("update_asteroids");
+	JobCounter done = {0};
+
 	if (check_win(asteroids)) {
 		
 		current_state = WIN_SCREEN;
 	}
 
-	for (int i = 0; i < NUM_ASTEROIDS; i++) {
-	
-		//update position
-		asteroids[i].model.position = v3_add(asteroids[i].model.position, asteroids[i].model.velocity);
+	jobs_parallel_for(jobs, asteroid_integrate_job, asteroids, asteroids->count, ASTEROID_JOB_GRAIN, &done);
+	jobs_wait(jobs, &done);
+}
+
+void update_bullets(BulletPool *bullets, double delta_time) {
+
+	int hw = SCREEN_WIDTH / 2;
+	int hh = SCREEN_HEIGHT / 2;
+
+	//walk the live bullets backwards so releasing one doesn't skip the bullet swapped into its place
+	for (int k = bullets->pool.live_count - 1; k >= 0; k--) {
+		
+		Bullet *b = &bullets->items[bullets->pool.live[k]];
+		
+		b->model.position = v3_add(b->model.position, b->model.velocity);
+		b->time_alive += delta_time;
 
-		float n = (asteroids[i].spin) ? 0.01f : -0.01f;
+		if (b->time_alive >= BULLET_TIME) {
 
-		//update rotation
-		asteroids[i].model.rotation = v3_add(asteroids[i].model.rotation, (Vector3){0.0f, 0.0f, n});
+			pool_release(&bullets->pool, bullets->pool.live[k]);
+			continue;
+		}
 
 		//right
-		if (asteroids[i].model.position.x > hw) {
+		if (b->model.position.x > hw) {
 
-			 asteroids[i].model.position = (Vector3) {-hw, asteroids[i].model.position.y, asteroids[i].model.position.z};
+			 b->model.position = (Vector3) {-hw, b->model.position.y, b->model.position.z};
 		}
 
 		//top
-		if (asteroids[i].model.position.y > hh) {
+		if (b->model.position.y > hh) {
 			 
-			asteroids[i].model.position = (Vector3) {asteroids[i].model.position.x, -hh, asteroids[i].model.position.z};
+			b->model.position = (Vector3) {b->model.position.x, -hh, b->model.position.z};
 		}
 		
 		//left
-		if (asteroids[i].model.position.x < -hw) {
+		if (b->model.position.x < -hw) {
 		
-			asteroids[i].model.position = (Vector3) {hw, asteroids[i].model.position.y, asteroids[i].model.position.z};
+			b->model.position = (Vector3) {hw, b->model.position.y, b->model.position.z};
 		}
 		
 		//bottom
-		if (asteroids[i].model.position.y < -hh ) {
+		if (b->model.position.y < -hh ) {
 			 
-			asteroids[i].model.position = (Vector3) {asteroids[i].model.position.x, hh, asteroids[i].model.position.z};
+			b->model.position = (Vector3) {b->model.position.x, hh, b->model.position.z};
 		}
 	}
 }
 
-void update_bullets(Bullet *bullets, double delta_time) {
+//load the ship mesh, only done once, a new game keeps the mesh and resets the rest with reset_ship
+void init_ship(Ship *ship) {
+	
+	*ship = (Ship) {0};
+	load_ply(&ship->model, "ship.ply");
+	reset_ship(ship);
+}
+
+void reset_ship(Ship *ship) {
 
-	int hw = SCREEN_WIDTH / 2;
-	int hh = SCREEN_HEIGHT / 2;
+	Model3D mesh = ship->model;
+
+	ship->model = (Model3D) {0};
+	ship->model.local_verts = mesh.local_verts;
+	ship->model.facev = mesh.facev;
+	ship->model.meshf = mesh.meshf;
+	ship->model.local_count = mesh.local_count;
+	ship->model.facev_count = mesh.facev_count;
+	ship->model.meshf_count = mesh.meshf_count;
+	ship->model.scale_s = 30.0f;
+	ship->model.direction = (Vector3) {0.0f, 1.0f, 0.0f}; //default forward position
+	ship->lives = 3;
+}
+
+//the pool itself is allocated by init_bullets at the start of every game
+void bullet_pool_alloc(BulletPool *bullets, Arena *arena, int capacity) {
+
+	*bullets = (BulletPool) {0};
+	bullets->arena = arena;
+	bullets->capacity = (capacity < 1) ? 1 : capacity;
+}
+
+//give an empty pool its memory from the session arena, call after the arena has been reset
+//returns 1 when the arena budget can't hold the pool
+int init_bullets(BulletPool *bullets) {
+
+	int capacity = bullets->capacity;
 
-	for (int i = 0; i < NUM_BULLETS; i++) {
+	bullets->items = arena_alloc(bullets->arena, capacity * sizeof(Bullet));
+	bullets->hit = arena_alloc(bullets->arena, capacity * sizeof(int));
+	bullets->splits = arena_alloc(bullets->arena, capacity * sizeof(AsteroidSplit));
+
+	void *pool_mem = arena_alloc(bullets->arena, pool_bytes(capacity));
+
+	if (bullets->items == NULL || bullets->hit == NULL || bullets->splits == NULL || pool_mem == NULL) {
 		
-		if (bullets[i].alive == true) {
+		puts("Session memory budget is too small for the bullet pool");
+		return 1;
+	}
+
+	memset(bullets->items, 0, capacity * sizeof(Bullet));
+	memset(bullets->hit, 0, capacity * sizeof(int));
+	pool_init_in(&bullets->pool, capacity, pool_mem);
+
+	return 0;
+}
+
+//Every allocation a play-through makes comes from the session arena that the asteroids and bullets
+//share. Starting a game resets it in one go, so a restart frees nothing piecemeal and never leaks,
+//and after the first game the arena already holds enough blocks that a new one allocates nothing
+//returns 1 when the arena budget is too small for the game
+int new_game(Ship *ship, AsteroidField *asteroids, BulletPool *bullets, uint64_t seed) {
+
+	arena_reset(asteroids->arena);
+	reset_ship(ship);
+
+	if (init_bullets(bullets) != 0) {
 		
-			bullets[i].model.position = v3_add(bullets[i].model.position, bullets[i].model.velocity);
-			bullets[i].time_alive += delta_time;
+		return 1;
+	}
 
-			if (bullets[i].time_alive >= BULLET_TIME) {
+	return init_asteroids(asteroids, seed);
+}
 
-				bullets[i] = (Bullet) {0};
-				continue;
-			}
+//move the asteroid arrays, pool and grid into fresh arena memory with room for capacity asteroids
+//every live asteroid keeps its slot, returns 1 when the arena budget has run out
+static int asteroid_field_resize(AsteroidField *asteroids, int capacity) {
 
-			//right
-			if (bullets[i].model.position.x > hw) {
+	capacity = (capacity + 7) & ~7;
 
-				 bullets[i].model.position = (Vector3) {-hw, bullets[i].model.position.y, bullets[i].model.position.z};
-			}
+	float **arrays[] = {&asteroids->pos_x, &asteroids->pos_y, &asteroids->prev_x, &asteroids->prev_y, &asteroids->vel_x, &asteroids->vel_y, &asteroids->rot_z, &asteroids->prev_rot_z, &asteroids->spin, &asteroids->scale};
+	int num_arrays = (int) (sizeof(arrays) / sizeof(arrays[0]));
+	float *fresh[sizeof(arrays) / sizeof(arrays[0])];
 
-			//top
-			if (bullets[i].model.position.y > hh) {
-				 
-				bullets[i].model.position = (Vector3) {bullets[i].model.position.x, -hh, bullets[i].model.position.z};
-			}
-			
-			//left
-			if (bullets[i].model.position.x < -hw) {
+	//take all the memory first so a failed resize leaves the field as it was
+	for (int i = 0; i < num_arrays; i++) {
+		
+		fresh[i] = arena_alloc(asteroids->arena, capacity * sizeof(float));
+
+		if (fresh[i] == NULL) {
 			
-				bullets[i].model.position = (Vector3) {hw, bullets[i].model.position.y, bullets[i].model.position.z};
-			}
+			return 1;
+		}
+	}
+
+	uint8_t *size = arena_alloc(asteroids->arena, capacity * sizeof(uint8_t));
+	int *next_cell = arena_alloc(asteroids->arena, capacity * sizeof(int));
+	void *pool_mem = arena_alloc(asteroids->arena, pool_bytes(capacity));
+	void *grid_mem = arena_alloc(asteroids->arena, grid_bytes(&asteroids->grid, capacity));
+
+	if (size == NULL || next_cell == NULL || pool_mem == NULL || grid_mem == NULL) {
+		
+		return 1;
+	}
+
+	for (int i = 0; i < num_arrays; i++) {
+		
+		memset(fresh[i], 0, capacity * sizeof(float));
+
+		if (asteroids->capacity > 0) {
 			
-			//bottom
-			if (bullets[i].model.position.y < -hh ) {
-				 
-				bullets[i].model.position = (Vector3) {bullets[i].model.position.x, hh, bullets[i].model.position.z};
-			}
+			memcpy(fresh[i], *arrays[i], asteroids->capacity * sizeof(float));
 		}
+
+		*arrays[i] = fresh[i];
 	}
-}
 
-void init_ship(Ship *ship) {
-	
-	*ship = (Ship) {0};
-	load_ply(&ship->model, "ship.ply");
-	ship->model.scale_s = 30.0f;
-	ship->model.direction = (Vector3) {0.0f, 1.0f, 0.0f}; //default forward position
-	ship->lives = 3;
+	memset(size, 0, capacity * sizeof(uint8_t));
+
+	if (asteroids->capacity > 0) {
+		
+		memcpy(size, asteroids->size, asteroids->capacity * sizeof(uint8_t));
+		pool_grow_in(&asteroids->pool, capacity, pool_mem);
+		grid_grow_in(&asteroids->grid, capacity, grid_mem);
+		asteroids->grow_count++;
+
+	} else {
+		
+		pool_init_in(&asteroids->pool, capacity, pool_mem);
+		grid_init_in(&asteroids->grid, capacity, grid_mem);
+	}
+
+	asteroids->size = size;
+	asteroids->next_cell = next_cell;
+	asteroids->capacity = capacity;
+
+	return 0;
 }
 
-void init_bullets(Bullet *bullets) {
+//set up an empty field that takes its memory from arena, it starts with room for capacity asteroids
+//and doubles whenever it runs out, each new wave has wave_size large asteroids
+int asteroid_field_alloc(AsteroidField *asteroids, Arena *arena, int capacity, int wave_size) {
 
-	for (int i = 0; i < NUM_BULLETS; i++) {
-	
-		bullets[i] = (Bullet) {0};
+	*asteroids = (AsteroidField) {0};
+	asteroids->arena = arena;
+	asteroids->initial_capacity = (capacity < 1) ? 1 : capacity;
+	asteroids->wave_size = wave_size;
+
+	load_ply(&asteroids->mesh, "asteroid1.ply");
+
+	for (int i = 0; i < asteroids->mesh.local_count; i++) {
+		
+		Vector3 v = asteroids->mesh.local_verts[i];
+		float r = sqrtf(v.x * v.x + v.y * v.y);
+
+		asteroids->outline_radius = (r > asteroids->outline_radius) ? r : asteroids->outline_radius;
 	}
+
+	return 0;
+}
+
+//the arrays belong to the arena, only the mesh is freed here
+void asteroid_field_free(AsteroidField *asteroids) {
+
+	model3D_free(&asteroids->mesh);
+	*asteroids = (AsteroidField) {0};
 }
 
-void init_asteroids(Asteroid *asteroids) {
+//put a new asteroid of the given size at x,y heading in a direction drawn from rng
+//returns its slot or -1 when the field is full and the arena budget will not let it grow
+int add_asteroid(AsteroidField *asteroids, Rng *rng, float x, float y, asteroid_size_t a_size) {
+
+	int i = pool_alloc(&asteroids->pool);
+
+	if (i < 0) {
+		
+		//a failed grow keeps the arena memory it got before running out, trying again would only use up the rest
+		if (asteroids->full || asteroid_field_resize(asteroids, asteroids->capacity * 2) != 0) {
+			
+			asteroids->full = true;
+			asteroids->dropped++;
+			return -1;
+		}
+
+		i = pool_alloc(&asteroids->pool);
+	}
 
-	for (int i = 0; i < NUM_ASTEROIDS; i++) {
+	if (i >= asteroids->count) {
 		
-		float angle = random_float(0, TWO_PI);
-		float speed = 0.3f;
-		float vx = cosf(angle) * speed;
-		float vy = sinf(angle) * speed;
-		int hw = SCREEN_WIDTH / 2;
-		int hh = SCREEN_HEIGHT / 2;
+		asteroids->count = i + 1;
+	}
+
+	if (asteroids->pool.live_count > asteroids->peak_live) {
 		
-		asteroids[i].model = (Model3D) {0};			
-		load_ply(&asteroids[i].model, "asteroid1.ply");
-		asteroids[i].spin = rand() % 2;
-		asteroids[i].model.position = (Vector3) {(rand() % SCREEN_WIDTH) - hw, (rand() % SCREEN_HEIGHT) - hh, 0.0f};
-		asteroids[i].model.velocity = (Vector3) {vx, vy, 0.0f};
-		asteroids[i].model.rotation = (Vector3) {0.0f, 0.0f, 0.01f};
+		asteroids->peak_live = asteroids->pool.live_count;
+	}
+
+	float angle = rng_float(rng, 0, TWO_PI);
+	float speed = 0.3f;
+	float c, sn;
 
-		if (i < 3) {
+	sim_sincos(angle, &sn, &c);
 
-			asteroids[i].size = AST_LARGE;
-			asteroids[i].model.scale_s = 60.0f;
-			asteroids[i].alive = true;
+	asteroids->spin[i] = (rng_next(rng) & 1) ? 0.01f : -0.01f;
+	asteroids->pos_x[i] = asteroids->prev_x[i] = x;
+	asteroids->pos_y[i] = asteroids->prev_y[i] = y;
+	asteroids->vel_x[i] = c * speed;
+	asteroids->vel_y[i] = sn * speed;
+	asteroids->rot_z[i] = asteroids->prev_rot_z[i] = 0.01f;
+	asteroids->size[i] = a_size;
+	asteroids->scale[i] = (a_size == AST_LARGE) ? 60.0f : (a_size == AST_MEDIUM) ? 30.0f : 15.0f;
+	grid_update(&asteroids->grid, i, x, y);
 
-		} else if (i > 2 && i < 12) {
+	return i;
+}
 
-			asteroids[i].size = AST_MEDIUM;
-			asteroids[i].model.scale_s = 30.0f;
-			asteroids[i].alive = false;
+void remove_asteroid(AsteroidField *asteroids, int id) {
 
-		} else {
+	pool_release(&asteroids->pool, id);
+	grid_remove(&asteroids->grid, id);
+}
 
-			asteroids[i].size = AST_SMALL;
-			asteroids[i].model.scale_s = 15.0f;
-			asteroids[i].alive = false;
-		}
+//start a new wave of large asteroids in memory from the session arena, called by new_game once the arena has been reset
+//the wave and every fragment split from it are drawn from seed, so the same seed and inputs replay exactly
+//returns 1 when the arena budget can't hold the initial capacity
+int init_asteroids(AsteroidField *asteroids, uint64_t seed) {
+
+	int hw = SCREEN_WIDTH / 2;
+	int hh = SCREEN_HEIGHT / 2;
+
+	rng_seed(&asteroids->rng, seed, 0);
+	asteroids->seed = seed;
+	asteroids->capacity = 0;
+	asteroids->count = 0;
+	asteroids->full = false;
+	grid_layout(&asteroids->grid, SCREEN_WIDTH, SCREEN_HEIGHT, GRID_CELL);
+
+	if (asteroid_field_resize(asteroids, asteroids->initial_capacity) != 0) {
+		
+		puts("Session memory budget is too small for the initial asteroid capacity");
+		return 1;
+	}
+
+	for (int i = 0; i < asteroids->wave_size; i++) {
+		
+		float x = rng_range(&asteroids->rng, SCREEN_WIDTH) - hw;
+		float y = rng_range(&asteroids->rng, SCREEN_HEIGHT) - hh;
+
+		add_asteroid(asteroids, &asteroids->rng, x, y, AST_LARGE);
 	}
+
+	return 0;
 }
 
 void setModelDirection(Model3D *model, float amount) {
@@ -604,24 +1773,50 @@ void setModelDirection(Model3D *model, float amount) {
 	model->direction = v3_rotate(model->direction, model->rotation);
 }
 
-void project(Model3D *model, float hw, float hh) {
+void save_state(Model3D *model) {
+
+	model->prev_position = model->position;
+	model->prev_rotation = model->rotation;
+}
+
+//position between the last two ticks, alpha 0 is the previous tick and 1 the current one
+Vector3 lerp_position(Model3D *model, float alpha) {
+
+	Vector3 d = v3_sub(model->position, model->prev_position);
+
+	//the model wrapped around the screen edge this tick, don't slide it back across the screen
+	if (fabsf(d.x) > SCREEN_WIDTH / 2 || fabsf(d.y) > SCREEN_HEIGHT / 2) {
+		
+		return model->position;
+	}
+
+	return v3_add(model->prev_position, v3_multi_s(d, alpha));
+}
+
+//project the vertices of a model into screen_verts, which needs room for model->local_count of them
+void project(Model3D *model, Vector3 *screen_verts, float hw, float hh, float alpha) {
+
+	PROF_SCOPE(PROF_PROJECT);
+	Vector3 position = lerp_position(model, alpha);
+	Vector3 rotation = v3_add(model->prev_rotation, v3_multi_s(v3_sub(model->rotation, model->prev_rotation), alpha));
 	
 	for (int i = 0; i < model->local_count; i++) {
 		
 		Vector3 scaled_model = v3_multi_s(model->local_verts[i], model->scale_s); 
-		Vector3 rot_model = v3_rotate(scaled_model, model->rotation);
-		Vector3 translation = v3_add(rot_model, model->position);
+		Vector3 rot_model = v3_rotate(scaled_model, rotation);
+		Vector3 translation = v3_add(rot_model, position);
 		
 		//push vert to focal length
 		translation.z += Z_OFFSET;
 
-		model->screen_verts[i].x = hw + ((translation.x / translation.z) * FOCAL_LENGTH);
-		model->screen_verts[i].y = hh - ((translation.y / translation.z) * FOCAL_LENGTH);
+		screen_verts[i].x = hw + ((translation.x / translation.z) * FOCAL_LENGTH);
+		screen_verts[i].y = hh - ((translation.y / translation.z) * FOCAL_LENGTH);
 	}
 }
 
-void draw_mesh(App *app, Model3D *model) {
+void draw_mesh(App *app, Model3D *model, Vector3 *screen_verts) {
 
+	PROF_SCOPE(PROF_DRAW_MESH);
 	int offset = 0;
 
 	//draw each face of the mesh
@@ -638,9 +1833,9 @@ void draw_mesh(App *app, Model3D *model) {
 			int i2 = model->meshf[offset + 2];
 
 			//Get their 2D Screen coordinates (already projected)
-			Vector3 p0 = model->screen_verts[i0];
-			Vector3 p1 = model->screen_verts[i1];
-			Vector3 p2 = model->screen_verts[i2];
+			Vector3 p0 = screen_verts[i0];
+			Vector3 p1 = screen_verts[i1];
+			Vector3 p2 = screen_verts[i2];
 
 			//Calculate the "Side" (2D Cross Product)
 			//This tells us if the points are winding CCW or CW
@@ -655,8 +1850,8 @@ void draw_mesh(App *app, Model3D *model) {
 				int index_1 = model->meshf[offset + j];
 				int index_2 = model->meshf[offset + (j + 1) % n];
 
-				Vector3 v1 = model->screen_verts[index_1];
-				Vector3 v2 = model->screen_verts[index_2];
+				Vector3 v1 = screen_verts[index_1];
+				Vector3 v2 = screen_verts[index_2];
 
 				//draw line
 				draw_line(app, v1.x, v1.y, v2.x, v2.y, 0x0000ff00);
@@ -667,40 +1862,65 @@ void draw_mesh(App *app, Model3D *model) {
 	}
 }
 
-void draw_asteroids(App *app, Asteroid *asteroids, int hw, int hh) {
+//project and draw one model with its screen space vertices in the frame arena
+void draw_model(App *app, Arena *frame, Model3D *model, float hw, float hh, float alpha) {
+
+	Vector3 *screen_verts = arena_alloc(frame, model->local_count * sizeof(Vector3));
+
+	if (screen_verts == NULL) {
+		
+		return;
+	}
+
+	project(model, screen_verts, hw, hh, alpha);
+	draw_mesh(app, model, screen_verts);
+}
+
+void draw_asteroids(App *app, Arena *frame, AsteroidField *asteroids, int hw, int hh, float alpha) {
+
+	Model3D *mesh = &asteroids->mesh;
+	Vector3 *screen_verts = arena_alloc(frame, mesh->local_count * sizeof(Vector3));	//every asteroid shares the mesh so one projection buffer does them all
+
+	if (screen_verts == NULL) {
+		
+		return;
+	}
 
-	//project asteroids to screen space and draw to screen
-	for (int i = 0; i < NUM_ASTEROIDS; i++) {
+	//load each live asteroids state into the shared mesh, project it to screen space and draw it
+	for (int k = 0; k < asteroids->pool.live_count; k++) {
 		
-		project(&asteroids[i].model, hw, hh);
+		int i = asteroids->pool.live[k];
 
-		if (asteroids[i].alive) {
+		mesh->position = (Vector3) {asteroids->pos_x[i], asteroids->pos_y[i], 0.0f};
+		mesh->prev_position = (Vector3) {asteroids->prev_x[i], asteroids->prev_y[i], 0.0f};
+		mesh->rotation = (Vector3) {0.0f, 0.0f, asteroids->rot_z[i]};
+		mesh->prev_rotation = (Vector3) {0.0f, 0.0f, asteroids->prev_rot_z[i]};
+		mesh->scale_s = asteroids->scale[i];
 
-			draw_mesh(app, &asteroids[i].model);
-		}
+		project(mesh, screen_verts, hw, hh, alpha);
+		draw_mesh(app, mesh, screen_verts);
 	}
 }
 
-void draw_bullets(App *app, Bullet *bullets, int hw, int hh) {
+void draw_bullets(App *app, BulletPool *bullets, int hw, int hh, float alpha) {
 
 	//draw to screen
-	for (int i = 0; i < NUM_BULLETS; i++) {
+	for (int k = 0; k < bullets->pool.live_count; k++) {
 		
-		if (bullets[i].alive) {
-			
-			//translate to center screen co ords
-			Vector3 trans = (Vector3) {0.0f + hw, 0.0f + hh, 0.0f};
-			Vector3 new_pos = v3_add(bullets[i].model.position, trans);
-			
-			float x = new_pos.x;
-			float y = new_pos.y;
+		Bullet *b = &bullets->items[bullets->pool.live[k]];
 
-			draw_arc(app, (int) x, (int) y, 10, 10, 0, 64 * 360, 0xFFFFFFFF);
-		}
+		//translate to center screen co ords
+		Vector3 trans = (Vector3) {0.0f + hw, 0.0f + hh, 0.0f};
+		Vector3 new_pos = v3_add(lerp_position(&b->model, alpha), trans);
+		
+		float x = new_pos.x;
+		float y = new_pos.y;
+
+		draw_arc(app, (int) x, (int) y, 10, 10, 0, 64 * 360, 0xFFFFFFFF);
 	}
 }
 
-void draw_lives(App *app, Ship *lives, int num_lives, int hw, int hh) {
+void draw_lives(App *app, Arena *frame, Ship *lives, int num_lives, int hw, int hh) {
 	
 	float x_offset = 0;
 
@@ -710,8 +1930,7 @@ void draw_lives(App *app, Ship *lives, int num_lives, int hw, int hh) {
 		Vector3 trans = {-hw + 95 + x_offset, +hh - 15, 0.0f};
 		lives->model.position = v3_add(lives->model.position, trans);
 
-		project(&lives->model, hw, hh);
-		draw_mesh(app, &lives->model);
+		draw_model(app, frame, &lives->model, hw, hh, 1.0f);
 		x_offset += lives->model.scale_s * 2;
 	}
 }